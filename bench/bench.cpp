@@ -0,0 +1,357 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bus.hpp"
+#include "observation.hpp"
+#include "upscale.hpp"
+#include "video.hpp"
+
+// Microbenchmarks for the interpreter and the frontend hot paths. Prints a
+// JSON document with a fixed set of entries, in a fixed order, so results can
+// be diffed across commits
+
+namespace {
+typedef std::chrono::steady_clock Clock;
+
+// Code is laid out as a JMP over the interrupt handlers (RST 1 and 2, which
+// return right away), a prologue, a loop body repeated until it fills
+// kBodySize bytes, a JMP back to the body and an optional subroutine
+constexpr uint16_t kPrologue = 0x0018;
+constexpr uint16_t kBodyStart = 0x0028;
+constexpr size_t kBodySize = 0x1000;
+
+struct Program {
+  std::vector<uint8_t> code = std::vector<uint8_t>(0x2000, 0x00);
+  uint16_t pc = 0;
+
+  void Emit(std::initializer_list<uint8_t> bytes) {
+    for (auto byte : bytes) {
+      code[pc++] = byte;
+    }
+  }
+
+  void Emit16(uint8_t opcode, uint16_t addr) {
+    Emit({opcode, (uint8_t)(addr & 0xff), (uint8_t)(addr >> 8)});
+  }
+};
+
+// Emits `body` (which gets the address it is emitted at) in a loop
+Program MakeLoop(size_t bodyLength,
+                 const std::function<void(Program &)> &body,
+                 const std::function<void(Program &)> &subroutine = nullptr) {
+  Program p;
+
+  p.Emit16(0xc3, kPrologue);
+  // EI; RET
+  for (uint16_t handler : {0x0008, 0x0010}) {
+    p.pc = handler;
+    p.Emit({0xfb, 0xc9});
+  }
+
+  p.pc = kPrologue;
+  // LXI H, 0x2100; LXI SP, 0x2400; MVI A, 0x5a; LXI B, 0x1234; LXI D, 0x5678
+  p.Emit16(0x21, 0x2100);
+  p.Emit16(0x31, 0x2400);
+  p.Emit({0x3e, 0x5a});
+  p.Emit16(0x01, 0x1234);
+  p.Emit16(0x11, 0x5678);
+
+  p.pc = kBodyStart;
+  while (p.pc + bodyLength + 3 < kBodyStart + kBodySize) {
+    body(p);
+  }
+  p.Emit16(0xc3, kBodyStart);
+
+  if (subroutine) {
+    subroutine(p);
+  }
+
+  return p;
+}
+
+constexpr uint16_t kSubroutine = kBodyStart + kBodySize;
+
+struct Result {
+  std::string name;
+  std::string unit;
+  double value;
+  uint64_t iterations;
+};
+
+// Runs `fn` in batches until `minSeconds` elapsed, `repeat` times, and keeps
+// the fastest run. `fn` returns the amount of work units it did
+double Measure(double minSeconds, int repeat, uint64_t &iterations,
+               const std::function<uint64_t()> &fn) {
+  double best = 0;
+
+  for (int r = 0; r < repeat; ++r) {
+    uint64_t units = 0;
+    auto start = Clock::now();
+    std::chrono::duration<double> elapsed;
+
+    do {
+      units += fn();
+      elapsed = Clock::now() - start;
+    } while (elapsed.count() < minSeconds);
+
+    auto ns = elapsed.count() * 1e9 / units;
+    if (r == 0 || ns < best) {
+      best = ns;
+      iterations = units;
+    }
+  }
+
+  return best;
+}
+
+Result BenchOpcodes(const std::string &name, const Program &program,
+                    double minSeconds, int repeat) {
+  invaders::Bus bus;
+  bus.Reset();
+  bus.LoadAt(program.code.data(), program.code.size(), 0x0000);
+
+  uint64_t iterations = 0;
+  auto ns = Measure(minSeconds, repeat, iterations, [&bus]() {
+    auto before = bus.cpu.Instructions();
+    bus.cpu.Run(100'000);
+    return bus.cpu.Instructions() - before;
+  });
+
+  return {"opcode/" + name, "ns_per_instruction", ns, iterations};
+}
+
+// `text` as a quoted JSON string
+std::string JSONString(const char *text) {
+  std::string out = "\"";
+  for (; *text != '\0'; ++text) {
+    auto c = (unsigned char)*text;
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (c < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out += escaped;
+    } else {
+      out += c;
+    }
+  }
+  return out + "\"";
+}
+
+Program MixedProgram() {
+  return MakeLoop(
+      12,
+      [](Program &p) {
+        // MOV B, C; ADD B; XRA E; MOV M, A; PUSH B; POP B; OUT 4; IN 3
+        p.Emit({0x41, 0x80, 0xab, 0x77, 0xc5, 0xc1, 0xd3, 0x04, 0xdb, 0x03});
+        // JNZ next
+        p.Emit16(0xc2, p.pc + 3);
+      });
+}
+} // namespace
+
+int main(int argc, char **args) {
+  const char *romPath = nullptr;
+  double minSeconds = 0.2;
+  int repeat = 5;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(args[i], "--min-time") == 0 && i + 1 < argc) {
+      minSeconds = std::stod(args[++i]);
+    } else if (strcmp(args[i], "--repeat") == 0 && i + 1 < argc) {
+      repeat = std::stoi(args[++i]);
+    } else if (strcmp(args[i], "--help") == 0) {
+      std::cout << "Usage: " << args[0]
+                << " [rom] [--min-time SECONDS] [--repeat N]" << std::endl;
+      return 0;
+    } else {
+      romPath = args[i];
+    }
+  }
+
+  std::vector<Result> results;
+
+  // MOV r, r and MOV with memory operands
+  results.push_back(BenchOpcodes(
+      "mov",
+      MakeLoop(8,
+               [](Program &p) {
+                 // MOV B, C; MOV D, E; MOV E, A; MOV A, M; MOV M, A; MVI C
+                 p.Emit({0x41, 0x53, 0x5f, 0x7e, 0x77, 0x0e, 0x33});
+               }),
+      minSeconds, repeat));
+
+  // Arithmetic, logic and the flag computations behind them
+  results.push_back(BenchOpcodes(
+      "alu",
+      MakeLoop(12,
+               [](Program &p) {
+                 // ADD B; SUB C; ANA D; XRA E; ORA H; CMP L; INR A; DCR B;
+                 // ADI 0x11; DAD B; RLC
+                 p.Emit({0x80, 0x91, 0xa2, 0xab, 0xb4, 0xbd, 0x3c, 0x05, 0xc6,
+                         0x11, 0x09, 0x07});
+               }),
+      minSeconds, repeat));
+
+  // Jumps to the next instruction, so taken and not taken paths continue
+  results.push_back(BenchOpcodes(
+      "branch",
+      MakeLoop(16,
+               [](Program &p) {
+                 // CMC; JMP; JNZ; JZ; JC; JNC
+                 p.Emit({0x3f});
+                 for (auto opcode : {0xc3, 0xc2, 0xca, 0xda, 0xd2}) {
+                   p.Emit16(opcode, p.pc + 3);
+                 }
+               }),
+      minSeconds, repeat));
+
+  results.push_back(BenchOpcodes(
+      "stack",
+      MakeLoop(
+          8,
+          [](Program &p) {
+            // PUSH B; PUSH PSW; POP PSW; POP B; CALL sub
+            p.Emit({0xc5, 0xf5, 0xf1, 0xc1});
+            p.Emit16(0xcd, kSubroutine);
+          },
+          [](Program &p) {
+            // RET
+            p.Emit({0xc9});
+          }),
+      minSeconds, repeat));
+
+  // The shift register ports
+  results.push_back(BenchOpcodes(
+      "io_shift",
+      MakeLoop(6,
+               [](Program &p) {
+                 // OUT 2; OUT 4; IN 3
+                 p.Emit({0xd3, 0x02, 0xd3, 0x04, 0xdb, 0x03});
+               }),
+      minSeconds, repeat));
+
+  // A full frame with both interrupts, on the ROM when one is given
+  {
+    invaders::Bus bus;
+    bus.Reset();
+
+    if (romPath != nullptr) {
+      if (!bus.LoadROM(romPath)) {
+        return -1;
+      }
+    } else {
+      auto program = MixedProgram();
+      bus.LoadAt(program.code.data(), program.code.size(), 0x0000);
+    }
+
+    uint64_t iterations = 0;
+    auto ns = Measure(minSeconds, repeat, iterations, [&bus]() {
+      bus.RunFrame();
+      return 1;
+    });
+    results.push_back({"frame", "ns_per_frame", ns, iterations});
+  }
+
+  // VRAM to RGB conversion of a busy screen
+  {
+    std::vector<uint8_t> vram(invaders::kVRAMSize);
+    for (size_t i = 0; i < vram.size(); ++i) {
+      vram[i] = (uint8_t)(i * 0x9e3779b1 >> 24);
+    }
+    std::vector<uint8_t> rgb(invaders::kScreenWidth * invaders::kScreenHeight *
+                             3);
+
+    uint64_t iterations = 0;
+    auto ns = Measure(minSeconds, repeat, iterations, [&]() {
+      invaders::VRAMToRGB(vram.data(), rgb.data());
+      return 1;
+    });
+    results.push_back({"video/vram_to_rgb", "ns_per_frame", ns, iterations});
+
+    invaders::Phosphor phosphor(0.5);
+    ns = Measure(minSeconds, repeat, iterations, [&]() {
+      phosphor.Apply(vram.data(), rgb.data());
+      return 1;
+    });
+    results.push_back({"video/phosphor", "ns_per_frame", ns, iterations});
+
+    // Observation kernels on the same screen
+    const std::pair<const char *, invaders::ObservationType> kernels[] = {
+        {"observation/gray", invaders::OBS_GRAYSCALE},
+        {"observation/gray84", invaders::OBS_GRAY_84},
+        {"observation/bits84", invaders::OBS_BITS_84},
+    };
+    for (auto &kernel : kernels) {
+      std::vector<uint8_t> obs(invaders::ObservationSize(kernel.second));
+      ns = Measure(minSeconds, repeat, iterations, [&]() {
+        invaders::VRAMToObservation(vram.data(), kernel.second, obs.data());
+        return 1;
+      });
+      results.push_back({kernel.first, "ns_per_frame", ns, iterations});
+    }
+
+    // Upscalers, redoing the whole frame every time
+    const std::pair<const char *, invaders::ScaleFilter> filters[] = {
+        {"upscale/scale2x", invaders::SCALE_2X},
+        {"upscale/scale3x", invaders::SCALE_3X},
+        {"upscale/xbr", invaders::SCALE_XBR},
+    };
+    for (auto &filter : filters) {
+      invaders::Upscaler upscaler(filter.second);
+      ns = Measure(minSeconds, repeat, iterations, [&]() {
+        upscaler.Invalidate();
+        upscaler.Update(vram.data());
+        return 1;
+      });
+      results.push_back({filter.first, "ns_per_frame", ns, iterations});
+    }
+  }
+
+  // Save states
+  {
+    invaders::Bus bus;
+    bus.Reset();
+    auto program = MixedProgram();
+    bus.LoadAt(program.code.data(), program.code.size(), 0x0000);
+    bus.RunFrame();
+
+    std::vector<uint8_t> state(invaders::Bus::kStateSize);
+
+    uint64_t iterations = 0;
+    auto ns = Measure(minSeconds, repeat, iterations, [&]() {
+      bus.SaveState(state.data());
+      return 1;
+    });
+    results.push_back({"state/save", "ns_per_call", ns, iterations});
+
+    ns = Measure(minSeconds, repeat, iterations, [&]() {
+      bus.LoadState(state.data(), state.size());
+      return 1;
+    });
+    results.push_back({"state/load", "ns_per_call", ns, iterations});
+  }
+
+  std::cout << "{\n  \"version\": 1,\n  \"rom\": "
+            << (romPath == nullptr ? "null" : JSONString(romPath))
+            << ",\n  \"benchmarks\": [\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    auto &r = results[i];
+    std::cout << "    {\"name\": \"" << r.name << "\", \"unit\": \"" << r.unit
+              << "\", \"value\": " << std::fixed << std::setprecision(3)
+              << r.value << ", \"iterations\": " << r.iterations << "}"
+              << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  std::cout << "  ]\n}" << std::endl;
+
+  return 0;
+}
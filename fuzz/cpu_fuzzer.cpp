@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "cpu.hpp"
+#include "model8080.hpp"
+
+// Runs fuzzer generated memory images through three CPUs and checks that they
+// agree:
+//  - the stand-alone model in model8080.hpp, stepped one cycle at a time
+//  - the reference engine on bus callbacks, also stepped one cycle at a time
+//  - the fast engine on a page table, run in slices up to each interrupt
+// Input layout: cycles (2 bytes), interrupt period (1), interrupt vector (1),
+// then the memory image, which also provides the values read from IO ports
+
+namespace {
+constexpr uint32_t kMaxCycles = 20'000;
+constexpr int kPageBits = 10;
+constexpr size_t kHeaderSize = 4;
+
+// Memory and IO under fuzzer control, with a log of every write
+struct FuzzBus {
+  uint8_t memory[1 << 16] = {0};
+  const uint8_t *pages[(1 << 16) >> kPageBits];
+
+  const uint8_t *ioData;
+  size_t ioSize;
+  size_t ioReads = 0;
+
+  std::vector<uint32_t> writes;
+  std::vector<uint16_t> ioWrites;
+
+  FuzzBus(const uint8_t *image, size_t size) : ioData(image), ioSize(size) {
+    memcpy(memory, image, size);
+    for (size_t i = 0; i < sizeof(pages) / sizeof(pages[0]); ++i) {
+      pages[i] = memory + (i << kPageBits);
+    }
+  }
+
+  uint8_t Read(uint16_t addr) { return memory[addr]; }
+  void Write(uint16_t addr, uint8_t data) {
+    memory[addr] = data;
+    writes.push_back((uint32_t)addr << 8 | data);
+  }
+  uint8_t In(uint8_t port) {
+    if (ioSize == 0) {
+      return port;
+    }
+    return ioData[ioReads++ % ioSize] ^ port;
+  }
+  void Out(uint8_t port, uint8_t data) {
+    ioWrites.push_back((uint16_t)(port << 8 | data));
+  }
+
+  void Attach(invaders::CPU &cpu) {
+    cpu.SetBusFunctions(
+        [this](uint16_t addr) { return Read(addr); },
+        [this](uint16_t addr, uint8_t data) { Write(addr, data); },
+        [this](uint8_t port) { return In(port); },
+        [this](uint8_t port, uint8_t data) { Out(port, data); });
+  }
+
+  bool operator==(const FuzzBus &other) const {
+    return writes == other.writes && ioWrites == other.ioWrites &&
+           ioReads == other.ioReads &&
+           memcmp(memory, other.memory, sizeof(memory)) == 0;
+  }
+};
+
+void Check(bool condition, const char *what) {
+  if (!condition) {
+    std::cerr << "Mismatch: " << what << std::endl;
+    abort();
+  }
+}
+
+bool SameRegisters(const invaders::CPU::Registers &a,
+                   const invaders::CPU::Registers &b) {
+  return a.pc == b.pc && a.sp == b.sp && a.a == b.a && a.b == b.b &&
+         a.c == b.c && a.d == b.d && a.e == b.e && a.h == b.h && a.l == b.l &&
+         a.flags == b.flags && a.pendingCycles == b.pendingCycles &&
+         a.interrupts == b.interrupts;
+}
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  if (size < kHeaderSize) {
+    return 0;
+  }
+
+  uint32_t cycles = (data[0] | data[1] << 8) % kMaxCycles;
+  uint32_t period = data[2] * 64;
+  uint8_t vector = data[3] & 0x07;
+
+  auto image = data + kHeaderSize;
+  auto imageSize = std::min(size - kHeaderSize, (size_t)1 << 16);
+
+  auto modelBus = std::make_unique<FuzzBus>(image, imageSize);
+  auto referenceBus = std::make_unique<FuzzBus>(image, imageSize);
+  auto fastBus = std::make_unique<FuzzBus>(image, imageSize);
+
+  invaders::Model8080<FuzzBus> model(*modelBus);
+  invaders::CPU reference(nullptr, nullptr, nullptr, nullptr);
+  invaders::CPU fast(nullptr, nullptr, nullptr, nullptr);
+  referenceBus->Attach(reference);
+  fastBus->Attach(fast);
+  fast.SetMemoryPages(fastBus->pages, kPageBits);
+  fast.SetEngine(invaders::ENGINE_FAST);
+  reference.Reset();
+  fast.Reset();
+
+  uint32_t done = 0;
+  while (done < cycles) {
+    auto slice = cycles - done;
+    if (period != 0) {
+      slice = std::min(slice, period - done % period);
+    }
+
+    for (uint32_t i = 0; i < slice; ++i) {
+      model.Tick();
+      reference.Tick();
+    }
+    fast.Run(slice);
+    done += slice;
+
+    Check(model.Cycles() == done, "model cycle count");
+    Check(reference.Cycles() == done, "reference cycle count");
+    Check(fast.Cycles() == done, "fast cycle count");
+
+    if (period != 0 && done % period == 0) {
+      model.Interrupt(vector);
+      reference.Interrupt(vector);
+      fast.Interrupt(vector);
+    }
+  }
+
+  // Every instruction takes at least 4 cycles, the last one may still be
+  // running
+  Check(model.Instructions() * 4 <= model.Cycles() + 3, "instruction count");
+  Check(model.Instructions() == reference.Instructions(),
+        "reference instructions");
+  Check(model.Instructions() == fast.Instructions(), "fast instructions");
+  Check(SameRegisters(model.GetRegisters(), reference.GetRegisters()),
+        "reference registers");
+  Check(SameRegisters(model.GetRegisters(), fast.GetRegisters()),
+        "fast registers");
+  Check(*modelBus == *referenceBus, "reference memory and IO");
+  Check(*modelBus == *fastBus, "fast memory and IO");
+
+  return 0;
+}
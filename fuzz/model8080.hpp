@@ -0,0 +1,413 @@
+#include <stdint.h>
+
+#include "cpu.hpp"
+
+namespace invaders {
+#pragma once
+// Stand-alone 8080 model for the CPU fuzzer. It shares no code with cpu.cpp:
+// every opcode is decoded once into a table entry, flags come from a lookup
+// table, and the step function only dispatches on the decoded operation.
+//
+// It follows the datasheet, except where the emulator knowingly simplifies
+// the flags and HLT. Those differences are marked "As emulated" below, so a
+// mismatch points at an engine bug and not at a known inaccuracy
+template <typename Bus> class Model8080 {
+  enum Operation : uint8_t {
+    OP_NOP,
+    OP_MOV,
+    OP_MVI,
+    OP_ALU,
+    OP_ALU_IMMEDIATE,
+    OP_INR,
+    OP_DCR,
+    OP_INX,
+    OP_DCX,
+    OP_DAD,
+    OP_LXI,
+    OP_STAX,
+    OP_LDAX,
+    OP_SHLD,
+    OP_LHLD,
+    OP_STA,
+    OP_LDA,
+    OP_RLC,
+    OP_RRC,
+    OP_RAL,
+    OP_RAR,
+    OP_DAA,
+    OP_CMA,
+    OP_STC,
+    OP_CMC,
+    OP_JMP,
+    OP_JUMP_IF,
+    OP_CALL,
+    OP_CALL_IF,
+    OP_RET,
+    OP_RET_IF,
+    OP_RST,
+    OP_PUSH,
+    OP_POP,
+    OP_XCHG,
+    OP_XTHL,
+    OP_SPHL,
+    OP_PCHL,
+    OP_EI,
+    OP_DI,
+    OP_IN,
+    OP_OUT,
+  };
+
+  // Bits 3-5 of the opcode (destination, condition, ALU operation or RST
+  // vector), bits 0-2 (source) and bits 4-5 (register pair)
+  struct Decoded {
+    Operation op;
+    uint8_t x, y, rp;
+    uint8_t cycles;
+  };
+
+  static constexpr uint8_t kCarry = 0x01;
+  static constexpr uint8_t kParity = 0x04;
+  static constexpr uint8_t kAuxCarry = 0x10;
+  static constexpr uint8_t kZero = 0x40;
+  static constexpr uint8_t kSign = 0x80;
+
+  // Datasheet timings, the longer one for conditional calls and returns
+  static constexpr uint8_t kCycles[256] = {
+      4,  10, 7,  5,  5,  5,  7,  4,  4,  10, 7,  5,  5,  5,  7,  4,
+      4,  10, 7,  5,  5,  5,  7,  4,  4,  10, 7,  5,  5,  5,  7,  4,
+      4,  10, 16, 5,  5,  5,  7,  4,  4,  10, 16, 5,  5,  5,  7,  4,
+      4,  10, 13, 5,  10, 10, 10, 4,  4,  10, 13, 5,  5,  5,  7,  4,
+      5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5,
+      5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5,
+      5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5,
+      7,  7,  7,  7,  7,  7,  7,  7,  5,  5,  5,  5,  5,  5,  7,  5,
+      4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+      4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+      4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+      4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+      11, 10, 10, 10, 17, 11, 7,  11, 11, 10, 10, 10, 10, 17, 7,  11,
+      11, 10, 10, 10, 17, 11, 7,  11, 11, 10, 10, 10, 10, 17, 7,  11,
+      11, 10, 10, 18, 17, 11, 7,  11, 11, 5,  10, 5,  17, 17, 7,  11,
+      11, 10, 10, 4,  17, 11, 7,  11, 11, 5,  10, 4,  17, 17, 7,  11,
+  };
+
+  Bus &bus;
+  Decoded decoded[256];
+  // Sign, zero and parity flags of every byte
+  uint8_t szp[256];
+
+  // B, C, D, E, H, L, (M), A in opcode order
+  uint8_t reg[8] = {0};
+  uint8_t flags = 0;
+  uint16_t pc = 0, sp = 0;
+  bool interrupts = true;
+
+  uint8_t pending = 0;
+  uint64_t cycles = 0, instructions = 0;
+
+  static Operation Decode(uint8_t opcode) {
+    uint8_t x = (opcode >> 3) & 7, y = opcode & 7;
+    bool odd = (x & 1) != 0;
+
+    switch (opcode >> 6) {
+    case 0:
+      switch (y) {
+      case 0: return OP_NOP;
+      case 1: return odd ? OP_DAD : OP_LXI;
+      case 2: {
+        static const Operation loads[8] = {OP_STAX, OP_LDAX, OP_STAX, OP_LDAX,
+                                           OP_SHLD, OP_LHLD, OP_STA,  OP_LDA};
+        return loads[x];
+      }
+      case 3: return odd ? OP_DCX : OP_INX;
+      case 4: return OP_INR;
+      case 5: return OP_DCR;
+      case 6: return OP_MVI;
+      default: {
+        static const Operation rotates[8] = {OP_RLC, OP_RRC, OP_RAL, OP_RAR,
+                                             OP_DAA, OP_CMA, OP_STC, OP_CMC};
+        return rotates[x];
+      }
+      }
+    // As emulated, HLT does nothing
+    case 1: return opcode == 0x76 ? OP_NOP : OP_MOV;
+    case 2: return OP_ALU;
+    default:
+      switch (y) {
+      case 0: return OP_RET_IF;
+      case 1: {
+        static const Operation ops[8] = {OP_POP, OP_RET, OP_POP, OP_NOP,
+                                         OP_POP, OP_PCHL, OP_POP, OP_SPHL};
+        return ops[x];
+      }
+      case 2: return OP_JUMP_IF;
+      case 3: {
+        static const Operation ops[8] = {OP_JMP, OP_NOP,  OP_OUT,  OP_IN,
+                                         OP_XTHL, OP_XCHG, OP_DI, OP_EI};
+        return ops[x];
+      }
+      case 4: return OP_CALL_IF;
+      case 5: return odd ? (x == 1 ? OP_CALL : OP_NOP) : OP_PUSH;
+      case 6: return OP_ALU_IMMEDIATE;
+      default: return OP_RST;
+      }
+    }
+  }
+
+  uint8_t Fetch() { return bus.Read(pc++); }
+  uint16_t Fetch16() {
+    uint8_t low = Fetch();
+    return low | Fetch() << 8;
+  }
+
+  uint8_t Get(uint8_t r) { return r == 6 ? bus.Read(Pair(2)) : reg[r]; }
+  void Set(uint8_t r, uint8_t value) {
+    if (r == 6) {
+      bus.Write(Pair(2), value);
+    } else {
+      reg[r] = value;
+    }
+  }
+
+  // BC, DE, HL, SP
+  uint16_t Pair(uint8_t rp) const {
+    return rp == 3 ? sp : reg[rp * 2] << 8 | reg[rp * 2 + 1];
+  }
+  void SetPair(uint8_t rp, uint16_t value) {
+    if (rp == 3) {
+      sp = value;
+    } else {
+      reg[rp * 2] = value >> 8;
+      reg[rp * 2 + 1] = value & 0xff;
+    }
+  }
+
+  void Push(uint16_t value) {
+    bus.Write(sp - 1, value >> 8);
+    bus.Write(sp - 2, value & 0xff);
+    sp -= 2;
+  }
+  uint16_t Pop() {
+    uint16_t value = bus.Read(sp) | bus.Read(sp + 1) << 8;
+    sp += 2;
+    return value;
+  }
+
+  void Call() {
+    uint16_t target = Fetch16();
+    Push(pc);
+    pc = target;
+  }
+
+  // NZ, Z, NC, C, PO, PE, P, M
+  bool Condition(uint8_t cc) const {
+    static const uint8_t masks[4] = {kZero, kCarry, kParity, kSign};
+    return ((flags & masks[cc >> 1]) != 0) == ((cc & 1) != 0);
+  }
+
+  // As emulated, arithmetic leaves the auxiliary carry alone, and the carry
+  // is bit 8 of the 16 bit wrapped result
+  void ArithmeticFlags(uint32_t result) {
+    flags = (flags & ~(kSign | kZero | kParity | kCarry)) |
+            szp[result & 0xff] | ((result & 0xffff) > 0xff ? kCarry : 0);
+  }
+
+  // ADD, ADC, SUB, SBB, ANA, XRA, ORA, CMP
+  void Alu(uint8_t operation, uint8_t value) {
+    uint8_t &a = reg[7];
+    uint32_t carry = flags & kCarry;
+
+    switch (operation) {
+    case 0: ArithmeticFlags(a + value), a += value; break;
+    case 1: ArithmeticFlags(a + value + carry), a += value + carry; break;
+    case 2: ArithmeticFlags(a - value), a -= value; break;
+    case 3: ArithmeticFlags(a - value - carry), a -= value + carry; break;
+    case 7: ArithmeticFlags(a - value); break;
+    default:
+      if (operation == 4) {
+        a &= value;
+      } else if (operation == 5) {
+        a ^= value;
+      } else {
+        a |= value;
+      }
+      flags = (flags & ~(kSign | kZero | kParity | kCarry | kAuxCarry)) |
+              szp[a];
+      break;
+    }
+  }
+
+  void Step() {
+    uint8_t opcode = Fetch();
+    auto &op = decoded[opcode];
+    uint8_t &a = reg[7];
+
+    pending = op.cycles - 1;
+    ++instructions;
+
+    switch (op.op) {
+    case OP_NOP: break;
+    case OP_MOV: Set(op.x, Get(op.y)); break;
+    case OP_MVI: Set(op.x, Fetch()); break;
+    case OP_ALU: Alu(op.x, Get(op.y)); break;
+    case OP_ALU_IMMEDIATE: Alu(op.x, Fetch()); break;
+    case OP_INR:
+    case OP_DCR: {
+      uint8_t value = Get(op.x) + (op.op == OP_INR ? 1 : -1);
+      Set(op.x, value);
+      flags = (flags & ~(kSign | kZero | kParity)) | szp[value];
+    } break;
+    case OP_INX: SetPair(op.rp, Pair(op.rp) + 1); break;
+    case OP_DCX: SetPair(op.rp, Pair(op.rp) - 1); break;
+    case OP_DAD: {
+      uint32_t sum = Pair(2) + Pair(op.rp);
+      SetPair(2, sum);
+      flags = (flags & ~kCarry) | (sum >> 16);
+    } break;
+    case OP_LXI: SetPair(op.rp, Fetch16()); break;
+    case OP_STAX: bus.Write(Pair(op.rp), a); break;
+    case OP_LDAX: a = bus.Read(Pair(op.rp)); break;
+    case OP_SHLD: {
+      uint16_t addr = Fetch16();
+      bus.Write(addr, reg[5]);
+      bus.Write(addr + 1, reg[4]);
+    } break;
+    case OP_LHLD: {
+      uint16_t addr = Fetch16();
+      reg[5] = bus.Read(addr);
+      reg[4] = bus.Read(addr + 1);
+    } break;
+    case OP_STA: bus.Write(Fetch16(), a); break;
+    case OP_LDA: a = bus.Read(Fetch16()); break;
+    case OP_RLC:
+      flags = (flags & ~kCarry) | a >> 7;
+      a = a << 1 | a >> 7;
+      break;
+    case OP_RRC:
+      flags = (flags & ~kCarry) | (a & 1);
+      a = a >> 1 | a << 7;
+      break;
+    case OP_RAL: {
+      uint8_t carry = flags & kCarry;
+      flags = (flags & ~kCarry) | a >> 7;
+      a = a << 1 | carry;
+    } break;
+    case OP_RAR: {
+      uint8_t carry = flags & kCarry;
+      flags = (flags & ~kCarry) | (a & 1);
+      a = a >> 1 | carry << 7;
+    } break;
+    // As emulated, the carries going in are ignored and the flags only change
+    // with the high digit adjustment
+    case OP_DAA:
+      if ((a & 0x0f) > 9) {
+        a += 6;
+      }
+      if ((a & 0xf0) > 0x90) {
+        ArithmeticFlags(a + 0x60);
+        a += 0x60;
+      }
+      break;
+    case OP_CMA: a = ~a; break;
+    case OP_STC: flags |= kCarry; break;
+    case OP_CMC: flags ^= kCarry; break;
+    case OP_JMP: pc = Fetch16(); break;
+    case OP_JUMP_IF: {
+      uint16_t target = Fetch16();
+      if (Condition(op.x)) {
+        pc = target;
+      }
+    } break;
+    case OP_CALL: Call(); break;
+    case OP_CALL_IF:
+      if (Condition(op.x)) {
+        Call();
+      } else {
+        pc += 2;
+      }
+      break;
+    case OP_RET: pc = Pop(); break;
+    case OP_RET_IF:
+      if (Condition(op.x)) {
+        pc = Pop();
+      }
+      break;
+    case OP_RST:
+      Push(pc);
+      pc = op.x * 8;
+      break;
+    case OP_PUSH:
+      Push(op.rp == 3 ? a << 8 | flags : Pair(op.rp));
+      break;
+    case OP_POP: {
+      uint16_t value = Pop();
+      if (op.rp == 3) {
+        a = value >> 8;
+        flags = value & 0xff;
+      } else {
+        SetPair(op.rp, value);
+      }
+    } break;
+    case OP_XCHG: {
+      uint16_t de = Pair(1);
+      SetPair(1, Pair(2));
+      SetPair(2, de);
+    } break;
+    case OP_XTHL: {
+      uint16_t hl = Pair(2);
+      SetPair(2, Pop());
+      Push(hl);
+    } break;
+    case OP_SPHL: sp = Pair(2); break;
+    case OP_PCHL: pc = Pair(2); break;
+    case OP_EI: interrupts = true; break;
+    case OP_DI: interrupts = false; break;
+    case OP_IN: a = bus.In(Fetch()); break;
+    case OP_OUT: bus.Out(Fetch(), a); break;
+    }
+  }
+
+public:
+  explicit Model8080(Bus &bus) : bus(bus) {
+    for (int i = 0; i < 256; ++i) {
+      decoded[i] = {Decode(i), (uint8_t)((i >> 3) & 7), (uint8_t)(i & 7),
+                    (uint8_t)((i >> 4) & 3), kCycles[i]};
+
+      int bits = 0;
+      for (int b = 0; b < 8; ++b) {
+        bits += (i >> b) & 1;
+      }
+      szp[i] = (i & 0x80 ? kSign : 0) | (i == 0 ? kZero : 0) |
+               (bits % 2 == 0 ? kParity : 0);
+    }
+  }
+
+  // Runs one clock cycle. An instruction takes effect on its first cycle
+  void Tick() {
+    ++cycles;
+    if (pending > 0) {
+      --pending;
+    } else {
+      Step();
+    }
+  }
+
+  // INT is ignored while interrupts are disabled
+  void Interrupt(uint8_t vector) {
+    if (!interrupts) {
+      return;
+    }
+    Push(pc);
+    pc = vector * 8;
+    interrupts = false;
+  }
+
+  CPU::Registers GetRegisters() const {
+    return {pc,     sp,     reg[7], reg[0], reg[1],  reg[2],
+            reg[3], reg[4], reg[5], flags,  pending, interrupts};
+  }
+
+  uint64_t Cycles() const { return cycles; }
+  uint64_t Instructions() const { return instructions; }
+};
+} // namespace invaders
@@ -0,0 +1,34 @@
+#include <cstdlib>
+#include <iostream>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "bus.hpp"
+
+// Feeds fuzzer generated save states to Bus::LoadState. Invalid states must
+// be rejected, valid ones must run a frame and survive a save/load round
+// trip unchanged
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  invaders::Bus bus;
+  bus.Reset();
+
+  if (!bus.LoadState(data, size)) {
+    return 0;
+  }
+
+  bus.RunFrame();
+
+  std::vector<uint8_t> state(invaders::Bus::kStateSize);
+  bus.SaveState(state.data());
+
+  invaders::Bus restored;
+  if (!restored.LoadState(state.data(), state.size()) ||
+      restored.StateHash() != bus.StateHash()) {
+    std::cerr << "Save state round trip mismatch" << std::endl;
+    abort();
+  }
+
+  return 0;
+}
@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "audio.hpp"
+
+namespace invaders {
+// Length of each one shot sound, in seconds
+static const float kSoundLength[SOUND_COUNT] = {
+    0.0f,  // UFO, held
+    0.35f, // Shot
+    1.2f,  // Player death
+    0.25f, // Invader death
+    1.0f,  // Extra life
+    0.12f, 0.12f, 0.12f, 0.12f, // Fleet
+    1.0f,  // UFO hit
+};
+
+// Fleet march notes, descending
+static const float kFleetFrequency[4] = {98.0f, 87.3f, 82.4f, 73.4f};
+
+static constexpr float kTwoPi = 6.28318530718f;
+
+Audio::Audio(size_t eventCapacity, size_t sampleCapacity)
+    : events(eventCapacity), samples(sampleCapacity) {}
+
+Audio::~Audio() { Stop(); }
+
+void Audio::Start(bool playback, WavWriter *wav) {
+  Stop();
+
+  this->playback = playback;
+  this->wav = wav;
+  running = true;
+  mixer = std::thread(&Audio::MixerLoop, this);
+}
+
+void Audio::Stop() {
+  if (!running) {
+    return;
+  }
+
+  running = false;
+  mixer.join();
+}
+
+void Audio::Queue(const Event &event) {
+  if (!events.TryPush(event)) {
+    droppedEvents.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void Audio::WritePort(uint64_t cycle, uint8_t port, uint8_t value) {
+  auto &last = port == 3 ? lastPort3 : lastPort5;
+  if (value == last) {
+    return;
+  }
+  last = value;
+
+  Queue({cycle, port, value});
+}
+
+void Audio::Read(int16_t *dst, size_t count) {
+  auto read = samples.PopBatch(dst, count);
+  if (read < count) {
+    std::fill(dst + read, dst + count, 0);
+    underruns.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void Audio::MixerLoop() {
+  DrainUntilStopped(events, running, 256,
+                    [this](const Event *batch, size_t count) {
+                      for (size_t i = 0; i < count; ++i) {
+                        RenderUntil(batch[i].cycle);
+                        Apply(batch[i]);
+                      }
+                    });
+}
+
+void Audio::Apply(const Event &event) {
+  if (event.port == 0) {
+    return;
+  }
+
+  auto &latch = event.port == 3 ? port3 : port5;
+  auto rising = event.value & ~latch;
+  latch = event.value;
+
+  auto trigger = [this](Sound sound) { voices[sound] = {true, 0, 0.0f}; };
+
+  if (event.port == 3) {
+    // The UFO plays for as long as its bit is set
+    voices[SOUND_UFO].active = (event.value & 1) != 0;
+    for (int bit = 1; bit < 5; ++bit) {
+      if (rising & (1 << bit)) {
+        trigger((Sound)(SOUND_UFO + bit));
+      }
+    }
+  } else {
+    for (int bit = 0; bit < 5; ++bit) {
+      if (rising & (1 << bit)) {
+        trigger((Sound)(SOUND_FLEET_1 + bit));
+      }
+    }
+  }
+}
+
+void Audio::RenderUntil(uint64_t cycle) {
+  if (!hasOrigin) {
+    originCycle = cycle;
+    hasOrigin = true;
+  }
+
+  // Time went backwards (reset or state load), restart the timeline
+  if (cycle < originCycle) {
+    originCycle = cycle;
+    renderedSamples = 0;
+  }
+
+  auto target = (cycle - originCycle) * kSampleRate / kAudioCPUClock;
+  if (target <= renderedSamples) {
+    return;
+  }
+
+  // Skip long gaps instead of rendering seconds of silence at once
+  if (target - renderedSamples > kSampleRate) {
+    renderedSamples = target - kSampleRate;
+  }
+
+  std::vector<int16_t> block(target - renderedSamples);
+  for (auto &sample : block) {
+    sample = NextSample();
+  }
+  renderedSamples = target;
+
+  if (wav != nullptr) {
+    wav->Write(block.data(), block.size());
+  }
+
+  if (playback) {
+    for (auto sample : block) {
+      if (!samples.TryPush(sample)) {
+        droppedSamples.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+}
+
+float Audio::NextNoise() {
+  // 16-bit Galois LFSR
+  noise = (noise >> 1) ^ (-(noise & 1) & 0xb400);
+  return (noise & 1) ? 1.0f : -1.0f;
+}
+
+float Audio::VoiceSample(Sound sound, Voice &voice) {
+  float t = (float)voice.age / kSampleRate;
+  float length = kSoundLength[sound];
+
+  if (sound != SOUND_UFO && t >= length) {
+    voice.active = false;
+    return 0.0f;
+  }
+  ++voice.age;
+
+  // Linear fade out over the whole sound
+  float envelope = sound == SOUND_UFO ? 1.0f : 1.0f - t / length;
+  float frequency;
+
+  auto square = [&voice](float frequency) {
+    voice.phase += frequency / kSampleRate;
+    voice.phase -= std::floor(voice.phase);
+    return voice.phase < 0.5f ? 1.0f : -1.0f;
+  };
+
+  switch (sound) {
+  case SOUND_UFO:
+    // Siren sweeping at 6 Hz
+    frequency = 700.0f + 200.0f * std::sin(kTwoPi * 6.0f * t);
+    return 0.25f * square(frequency);
+  case SOUND_SHOT:
+    // Falling pitch with some hiss
+    frequency = 1200.0f - 900.0f * t / length;
+    return envelope * (0.2f * square(frequency) + 0.1f * NextNoise());
+  case SOUND_PLAYER_DEATH:
+    // Low rumbling noise, held for a few samples at a time
+    if (voice.age % 24 == 1) {
+      voice.phase = NextNoise();
+    }
+    return 0.4f * envelope * envelope * voice.phase;
+  case SOUND_INVADER_DEATH:
+    if (voice.age % 12 == 1) {
+      voice.phase = NextNoise();
+    }
+    return 0.3f * envelope * voice.phase;
+  case SOUND_EXTRA_LIFE:
+    // 1 kHz tone chirping 8 times per second
+    return std::fmod(t * 8.0f, 1.0f) < 0.5f ? 0.2f * square(1000.0f) : 0.0f;
+  case SOUND_FLEET_1:
+  case SOUND_FLEET_2:
+  case SOUND_FLEET_3:
+  case SOUND_FLEET_4:
+    return 0.35f * envelope * square(kFleetFrequency[sound - SOUND_FLEET_1]);
+  case SOUND_UFO_HIT:
+    // Warbling tone
+    frequency = 800.0f + 400.0f * std::sin(kTwoPi * 12.0f * t);
+    return 0.25f * envelope * square(frequency);
+  default: return 0.0f;
+  }
+}
+
+int16_t Audio::NextSample() {
+  float mix = 0.0f;
+
+  for (int i = 0; i < SOUND_COUNT; ++i) {
+    if (voices[i].active) {
+      mix += VoiceSample((Sound)i, voices[i]);
+    }
+  }
+
+  if ((port3 & kSoundAmpEnable) == 0) {
+    mix = 0.0f;
+  }
+
+  mix = std::max(-1.0f, std::min(1.0f, mix));
+  return (int16_t)(mix * 32767.0f);
+}
+} // namespace invaders
@@ -0,0 +1,118 @@
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+
+#include "spsc.hpp"
+#include "wav.hpp"
+
+namespace invaders {
+#pragma once
+// Sounds triggered by the bits of ports 3 and 5
+enum Sound {
+  // Port 3
+  SOUND_UFO,           // Bit 0, loops while set
+  SOUND_SHOT,          // Bit 1
+  SOUND_PLAYER_DEATH,  // Bit 2
+  SOUND_INVADER_DEATH, // Bit 3
+  SOUND_EXTRA_LIFE,    // Bit 4
+  // Port 5
+  SOUND_FLEET_1, // Bit 0, the four invader march steps
+  SOUND_FLEET_2, // Bit 1
+  SOUND_FLEET_3, // Bit 2
+  SOUND_FLEET_4, // Bit 3
+  SOUND_UFO_HIT, // Bit 4
+  SOUND_COUNT,
+};
+
+// Port 3 bit 5 gates the amplifier
+constexpr uint8_t kSoundAmpEnable = 1 << 5;
+
+// Emulated clock used to place sound events in time, 60 frames per second
+constexpr uint32_t kAudioCPUClock = 33'000 * 60;
+
+// Procedural sound engine. The emulation thread queues sound port writes,
+// stamped with the CPU cycle, into a wait-free ring. A mixer thread edge
+// detects the port bits, synthesizes the sounds up to each event's cycle and
+// hands the samples to the audio callback through a second ring. Neither
+// ring ever blocks the emulation; events or samples are dropped instead
+class Audio {
+public:
+  static constexpr uint32_t kSampleRate = 48'000;
+
+private:
+  struct Event {
+    uint64_t cycle;
+    // 3 or 5, 0 only advances the time
+    uint8_t port;
+    uint8_t value;
+  };
+
+  struct Voice {
+    bool active;
+    // Samples since the trigger
+    uint32_t age;
+    float phase;
+  };
+
+  SpscRing<Event> events;
+  SpscRing<int16_t> samples;
+
+  std::atomic<uint64_t> droppedEvents{0};
+  std::atomic<uint64_t> droppedSamples{0};
+  std::atomic<uint64_t> underruns{0};
+
+  // Last values written by the emulation, so unchanged writes are not queued
+  uint8_t lastPort3 = 0;
+  uint8_t lastPort5 = 0;
+
+  std::thread mixer;
+  std::atomic<bool> running{false};
+  bool playback = false;
+  WavWriter *wav = nullptr;
+
+  // Mixer thread state
+  uint8_t port3 = 0;
+  uint8_t port5 = 0;
+  Voice voices[SOUND_COUNT] = {};
+  uint16_t noise = 0xace1;
+  bool hasOrigin = false;
+  uint64_t originCycle = 0;
+  uint64_t renderedSamples = 0;
+
+  void MixerLoop();
+  void Apply(const Event &event);
+  void RenderUntil(uint64_t cycle);
+  float NextNoise();
+  float VoiceSample(Sound sound, Voice &voice);
+  int16_t NextSample();
+
+  void Queue(const Event &event);
+
+public:
+  explicit Audio(size_t eventCapacity = 1 << 12,
+                 size_t sampleCapacity = 1 << 13);
+  ~Audio();
+
+  Audio(const Audio &) = delete;
+  Audio &operator=(const Audio &) = delete;
+
+  // Starts the mixer. With `playback` samples are queued for Read(), and
+  // they are also written to `wav` when set
+  void Start(bool playback, WavWriter *wav = nullptr);
+  // Renders every queued event and stops the mixer
+  void Stop();
+
+  // Emulation thread
+  void WritePort(uint64_t cycle, uint8_t port, uint8_t value);
+  // Lets the mixer render up to `cycle`
+  void Sync(uint64_t cycle) { Queue({cycle, 0, 0}); }
+
+  // Audio callback thread. Pads with silence when the mixer is behind
+  void Read(int16_t *dst, size_t count);
+
+  uint64_t DroppedEvents() const { return droppedEvents.load(); }
+  uint64_t DroppedSamples() const { return droppedSamples.load(); }
+  uint64_t Underruns() const { return underruns.load(); }
+};
+} // namespace invaders
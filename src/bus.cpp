@@ -1,22 +1,108 @@
+#include <algorithm>
 #include <fstream>
 #include <functional>
+#include <iomanip>
 #include <iostream>
+#include <memory>
 #include <stdint.h>
+#include <string.h>
 
 #include "bus.hpp"
 #include "cpu.hpp"
+#include "hash.hpp"
+#include "rom.hpp"
 
 namespace invaders {
 Bus::Bus()
-    : cpu(std::bind(&Bus::ReadMem, this, std::placeholders::_1),
-          std::bind(&Bus::WriteMem, this, std::placeholders::_1,
+    : cpu(std::bind(&Bus::ReadMem<false>, this, std::placeholders::_1),
+          std::bind(&Bus::WriteMem<false, false>, this, std::placeholders::_1,
                     std::placeholders::_2),
-          std::bind(&Bus::ReadIO, this, std::placeholders::_1),
-          std::bind(&Bus::WriteIO, this, std::placeholders::_1,
-                    std::placeholders::_2)) {}
+          std::bind(&Bus::ReadIO<false>, this, std::placeholders::_1),
+          std::bind(&Bus::WriteIO<false>, this, std::placeholders::_1,
+                    std::placeholders::_2)) {
+  // All pages start out as the same shared zero page
+  static const auto zeroPage = std::make_shared<MemPage>();
+  for (int i = 0; i < kPageCount; i++) {
+    pages[i] = zeroPage;
+    pageData[i] = zeroPage->data;
+  }
+  cpu.SetMemoryPages(pageData, kPageBits);
+
+  static const auto blankFrame = std::make_shared<VRAMFrame>();
+  display[0] = display[1] = blankFrame;
+}
+
+MemPage &Bus::WritablePage(uint16_t addr) {
+  auto index = addr >> kPageBits;
+  auto &page = pages[index];
+
+  if ((ownedPages & (1ull << index)) == 0) {
+    // Nobody else references the page anymore, no need to copy it
+    if (page.use_count() != 1) {
+      page = std::make_shared<MemPage>(*page);
+      pageData[index] = page->data;
+    }
+    ownedPages |= 1ull << index;
+  }
+
+  return *page;
+}
+
+VRAMFrame &Bus::WritableFrame(int index) {
+  auto &frame = display[index];
+  if (frame.use_count() != 1) {
+    frame = std::make_shared<VRAMFrame>(*frame);
+  }
+  return *frame;
+}
+
+template <bool Count> void Bus::BindCPUWith(bool logWrites) {
+  using std::placeholders::_1;
+  using std::placeholders::_2;
+
+  WriteBusFunction writeMem;
+  if (logWrites) {
+    writeMem = std::bind(&Bus::WriteMem<true, Count>, this, _1, _2);
+  } else {
+    writeMem = std::bind(&Bus::WriteMem<false, Count>, this, _1, _2);
+  }
+
+  cpu.SetBusFunctions(std::bind(&Bus::ReadMem<Count>, this, _1), writeMem,
+                      std::bind(&Bus::ReadIO<Count>, this, _1),
+                      std::bind(&Bus::WriteIO<Count>, this, _1, _2));
+}
+
+void Bus::BindCPU() {
+  bool logWrites = diagnostics & DIAG_LOG_MEM_WRITES;
 
+  // Counting reads needs every read to go through the callbacks
+  if (memoryStats != nullptr && (diagnostics & DIAG_MEM_STATS)) {
+    BindCPUWith<true>(logWrites);
+    cpu.SetMemoryPages(nullptr, kPageBits);
+  } else {
+    BindCPUWith<false>(logWrites);
+    cpu.SetMemoryPages(pageData, kPageBits);
+  }
+}
+
+void Bus::SetDiagnostics(uint32_t diagnostics) {
+  this->diagnostics = diagnostics;
+  BindCPU();
+  cpu.SetDiagnostics(diagnostics);
+}
+
+void Bus::SetMemoryStats(MemoryStats *stats) {
+  memoryStats = stats;
+  BindCPU();
+}
+
+template <bool LogWrites, bool Count>
 void Bus::WriteMem(uint16_t addr, uint8_t data) {
-  if (addr < 0x2000) {
+  if constexpr (Count) {
+    ++memoryStats->writes[addr];
+  }
+
+  if (addr < romSize) {
     // printf("Writing ROM not allowed %x\n", address);
     return;
   }
@@ -26,17 +112,47 @@ void Bus::WriteMem(uint16_t addr, uint8_t data) {
   //   return;
   // }
 
-#ifdef PRINT_MEM_WRITES
-  std::cout << "Mem write @" << std::hex << addr << ':' << +data << std::endl;
-#endif
+  if constexpr (LogWrites) {
+    std::cout << "Mem write @" << std::hex << addr << ':' << +data
+              << std::endl;
+  }
+
+  Poke(addr, data);
+}
+
+template <bool Count> uint8_t Bus::ReadMem(uint16_t addr) {
+  if constexpr (Count) {
+    ++memoryStats->reads[addr];
+  }
+
+  return Peek(addr);
+}
 
-  mem[addr] = data;
+void Bus::Poke(uint16_t addr, uint8_t data) {
+  auto &cell = WritablePage(addr).data[addr & (kPageSize - 1)];
+  memHash += HashMemCell(addr, data) - HashMemCell(addr, cell);
+  cell = data;
 }
 
-uint8_t Bus::ReadMem(uint16_t addr) { return mem[addr]; }
+void Bus::CopyMem(uint16_t start, uint8_t *dst, uint32_t len) const {
+  uint32_t addr = start;
+  while (len > 0 && addr < (1 << 16)) {
+    auto offset = addr & (kPageSize - 1);
+    auto chunk = std::min(len, kPageSize - offset);
+    memcpy(dst, pages[addr >> kPageBits]->data + offset, chunk);
+    dst += chunk;
+    addr += chunk;
+    len -= chunk;
+  }
+}
 
 // IO not implemented (yet)
-void Bus::WriteIO(uint8_t port, uint8_t data) {
+template <bool Count> void Bus::WriteIO(uint8_t port, uint8_t data) {
+  if constexpr (Count) {
+    ++memoryStats->ioWrites[port];
+    memoryStats->ioLastWrite[port] = data;
+  }
+
   switch (port) {
   // Shift register
   case 2: {
@@ -49,17 +165,30 @@ void Bus::WriteIO(uint8_t port, uint8_t data) {
     shift1 = data;
   } break;
 
+  // Sound triggers
+  case 3:
+  case 5: {
+    if (audio != nullptr) {
+      audio->WritePort(cpu.Cycles(), port, data);
+    }
+  } break;
+
   // Black-hole all other writes
   default: break;
   }
 }
 
-uint8_t Bus::ReadIO(uint8_t port) {
+template <bool Count> uint8_t Bus::ReadIO(uint8_t port) {
+  if constexpr (Count) {
+    ++memoryStats->ioReads[port];
+  }
+
   switch (port) {
-  case 0: return 1;
-  // case 1: return 0;
-  case 1: return port1;
-  // case 2: return 0;
+  // Bits 1-3 are tied high, the player 1 controls are mirrored from port 1
+  case 0: return 0b0000'1110 | (inputs & (P1_FIRE | P1_LEFT | P1_RIGHT));
+  // Bit 3 is tied high
+  case 1: return 0b0000'1000 | (inputs & 0xff);
+  case 2: return (inputs >> 8) | dipSwitches;
 
   // Shift register
   case 3: {
@@ -73,38 +202,389 @@ uint8_t Bus::ReadIO(uint8_t port) {
 }
 
 bool Bus::LoadFileAt(const std::string path, const uint16_t start) {
-  std::ifstream file(path, std::ios::binary);
-  if (!file) {
-    std::cerr << "Unable to load file \"" << path << "\", skipping..."
-              << std::endl;
+  MappedFile file;
+  if (!file.Open(path)) {
+    return false;
+  }
+
+  return LoadAt(file.Data(), file.Size(), start);
+}
+
+void Bus::LoadROM(const std::shared_ptr<const ROM> &rom) {
+  for (size_t i = 0; i < rom->PageCount(); ++i) {
+    // Swap the page's hash contribution for the ROM's
+    for (uint32_t offset = 0; offset < kPageSize; ++offset) {
+      auto addr = (uint16_t)(i * kPageSize + offset);
+      memHash -= HashMemCell(addr, pages[i]->data[offset]);
+    }
+    memHash += rom->PageHash(i);
+
+    // Shared pages are copied before being written, see WritablePage
+    pages[i] = std::const_pointer_cast<MemPage>(rom->Page(i));
+    pageData[i] = pages[i]->data;
+    ownedPages &= ~(1ull << i);
+  }
+}
+
+bool Bus::LoadROM(const std::string &path) {
+  auto rom = invaders::LoadROM(path);
+  if (rom == nullptr) {
     return false;
   }
 
-  int i = 0;
-  char b;
+  LoadROM(rom);
+  return true;
+}
 
-  while (file.get(b)) {
-    mem[i + start] = b;
-    ++i;
+bool Bus::LoadAt(const uint8_t *data, size_t size, const uint16_t start) {
+  if (start + size > (1 << 16)) {
+    std::cerr << "Unable to load " << size << " bytes at 0x" << std::hex
+              << start << ", out of bounds" << std::endl;
+    return false;
   }
 
-  file.close();
+  for (size_t i = 0; i < size; ++i) {
+    Poke(start + i, data[i]);
+  }
 
   return true;
 }
 
 void Bus::Reset() {
-  port1 = 0;
+  inputs = 0;
+  shift0 = 0;
+  shift1 = 0;
+  shiftOffset = 0;
+  frameHash = 0;
+  frameCount = 0;
+  frameCycle = 0;
+  inputQueue.clear();
+  queuedInputs = 0;
   cpu.Reset();
+  RehashMemory();
+  ResetDisplay();
 }
 
 void Bus::TickCPU() { cpu.Tick(); }
 
-void Bus::SetKeyboardState(KeyboardState state, bool pressed) {
-  if (pressed) {
-    port1 |= state;
+void Bus::Run(uint32_t cycles) {
+  while (cycles > 0) {
+    ApplyDueInputs();
+
+    // Run up to the next screen interrupt or queued input
+    auto chunk = std::min(cycles, kHalfFrameCycles -
+                                      frameCycle % kHalfFrameCycles);
+    if (!inputQueue.empty()) {
+      chunk = (uint32_t)std::min<uint64_t>(
+          chunk, inputQueue.front().cycle - cpu.Cycles());
+    }
+    cpu.Run(chunk);
+    frameCycle += chunk;
+    cycles -= chunk;
+
+    if (frameCycle == kHalfFrameCycles) {
+      CaptureLines(0, kVRAMLines / 2);
+      cpu.Interrupt(1);
+    } else if (frameCycle == kFrameCycles) {
+      CaptureLines(kVRAMLines / 2, kVRAMLines / 2);
+      presented ^= 1;
+      cpu.Interrupt(2);
+      VBlank();
+      frameCycle = 0;
+    }
+
+    if (audio != nullptr && frameCycle % kHalfFrameCycles == 0) {
+      audio->Sync(cpu.Cycles());
+    }
+  }
+}
+
+void Bus::CaptureLines(uint32_t first, uint32_t count) {
+  CopyMem(kVRAMStart + first * kVRAMLineSize,
+          WritableFrame(presented ^ 1).data + first * kVRAMLineSize,
+          count * kVRAMLineSize);
+}
+
+void Bus::ResetDisplay() {
+  CopyMem(kVRAMStart, WritableFrame(0).data, kVRAMSize);
+  // Shared until the next capture
+  display[1] = display[0];
+}
+
+void Bus::VBlank() {
+  frameHash = StateHash();
+  ++frameCount;
+
+  if (hashLog) {
+    *hashLog << std::dec << frameCount << ' ' << std::hex << std::setfill('0')
+             << std::setw(16) << frameHash << '\n';
+  }
+}
+
+uint64_t Bus::StateHash() const {
+  auto regs = cpu.GetRegisters();
+
+  uint64_t h = memHash;
+  h = HashCombine(h, ((uint64_t)regs.pc << 48) | ((uint64_t)regs.sp << 32) |
+                         ((uint64_t)regs.a << 24) | ((uint64_t)regs.b << 16) |
+                         ((uint64_t)regs.c << 8) | regs.d);
+  h = HashCombine(h, ((uint64_t)regs.e << 40) | ((uint64_t)regs.h << 32) |
+                         ((uint64_t)regs.l << 24) | ((uint64_t)regs.flags << 16) |
+                         ((uint64_t)regs.pendingCycles << 8) | regs.interrupts);
+  h = HashCombine(h, ((uint64_t)dipSwitches << 56) | ((uint64_t)shift0 << 40) |
+                         ((uint64_t)shift1 << 24) |
+                         ((uint64_t)(inputs >> 8) << 12) |
+                         ((uint64_t)shiftOffset << 8) | (inputs & 0xff));
+  return h;
+}
+
+void Bus::RehashMemory() {
+  memHash = 0;
+  for (uint32_t addr = 0; addr < (1 << 16); addr++) {
+    memHash += HashMemCell(addr, Peek(addr));
+  }
+}
+
+// "INVS" + format version, followed by the fields below in little-endian
+static const uint32_t kStateMagic = 0x53564e49;
+// Version 2 adds the cycle counter and the frame position, version 3 the
+// port 2 inputs and the DIP switches, version 4 the displayed frames after the
+// memory
+static const uint32_t kStateVersion = 4;
+static const size_t kStateHeaderSize = 64;
+static const size_t kStateHeaderSizeV1 = 48;
+
+const size_t Bus::kStateSize = kStateHeaderSize + (1 << 16) + 2 * kVRAMSize;
+
+void Bus::SaveState(uint8_t *dst) const {
+  auto put = [&dst](uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+      *dst++ = (value >> (i * 8)) & 0xff;
+    }
+  };
+
+  auto regs = cpu.GetRegisters();
+  auto *start = dst;
+
+  put(kStateMagic, 4);
+  put(kStateVersion, 4);
+  put(regs.pc, 2);
+  put(regs.sp, 2);
+  put(regs.a, 1);
+  put(regs.b, 1);
+  put(regs.c, 1);
+  put(regs.d, 1);
+  put(regs.e, 1);
+  put(regs.h, 1);
+  put(regs.l, 1);
+  put(regs.flags, 1);
+  put(regs.pendingCycles, 1);
+  put(regs.interrupts, 1);
+  put(shift0, 2);
+  put(shift1, 2);
+  put(shiftOffset, 2);
+  put(inputs & 0xff, 1);
+  put(frameHash, 8);
+  put(frameCount, 8);
+  put(cpu.Cycles(), 8);
+  put(frameCycle, 4);
+  put(inputs >> 8, 1);
+  put(dipSwitches, 1);
+  put(presented, 1);
+
+  // Reserved
+  while (dst < start + kStateHeaderSize) {
+    put(0, 1);
+  }
+
+  CopyMem(0, dst, 1 << 16);
+  dst += 1 << 16;
+  for (auto &frame : display) {
+    memcpy(dst, frame->data, kVRAMSize);
+    dst += kVRAMSize;
+  }
+}
+
+bool Bus::LoadState(const uint8_t *src, size_t size) {
+  auto get = [&src](int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+      value |= (uint64_t)*src++ << (i * 8);
+    }
+    return value;
+  };
+
+  auto *start = src;
+  if (size < 8 || get(4) != kStateMagic) {
+    std::cerr << "Invalid save state" << std::endl;
+    return false;
+  }
+
+  auto version = get(4);
+  auto headerSize = version == 1 ? kStateHeaderSizeV1 : kStateHeaderSize;
+  auto displaySize = version >= 4 ? 2 * kVRAMSize : 0;
+  if (version < 1 || version > kStateVersion ||
+      size < headerSize + (1 << 16) + displaySize) {
+    std::cerr << "Invalid save state" << std::endl;
+    return false;
+  }
+
+  CPU::Registers regs;
+  regs.pc = get(2);
+  regs.sp = get(2);
+  regs.a = get(1);
+  regs.b = get(1);
+  regs.c = get(1);
+  regs.d = get(1);
+  regs.e = get(1);
+  regs.h = get(1);
+  regs.l = get(1);
+  regs.flags = get(1);
+  regs.pendingCycles = get(1);
+  regs.interrupts = get(1);
+  cpu.SetRegisters(regs);
+
+  shift0 = get(2);
+  shift1 = get(2);
+  shiftOffset = get(2);
+  inputs = get(1);
+  frameHash = get(8);
+  frameCount = get(8);
+
+  // Version 1 states start a new timeline at a frame boundary
+  if (version == 1) {
+    cpu.SetCycles(0);
+    frameCycle = 0;
+  } else {
+    cpu.SetCycles(get(8));
+    frameCycle = get(4) % kFrameCycles;
+  }
+
+  if (version >= 3) {
+    inputs |= get(1) << 8;
+    dipSwitches = get(1);
+  }
+
+  auto displayed = version >= 4 ? get(1) & 1 : 0;
+
+  // Queued inputs belong to the previous timeline
+  inputQueue.clear();
+  queuedInputs = inputs;
+
+  src = start + headerSize;
+  for (uint32_t addr = 0; addr < (1 << 16); addr += kPageSize) {
+    memcpy(WritablePage(addr).data, src + addr, kPageSize);
+  }
+  RehashMemory();
+
+  // Older states show the live VRAM until the next frame is captured
+  if (version >= 4) {
+    src += 1 << 16;
+    for (int i = 0; i < 2; ++i) {
+      memcpy(WritableFrame(i).data, src + i * kVRAMSize, kVRAMSize);
+    }
+    presented = displayed;
   } else {
-    port1 &= ~state;
+    ResetDisplay();
   }
+
+  return true;
+}
+
+std::unique_ptr<Bus> Bus::Clone() {
+  auto clone = std::make_unique<Bus>();
+
+  // Both sides lose write ownership, the next write to a page copies it
+  for (int i = 0; i < kPageCount; i++) {
+    clone->pages[i] = pages[i];
+    clone->pageData[i] = pageData[i];
+  }
+  ownedPages = 0;
+
+  clone->cpu.SetRegisters(cpu.GetRegisters());
+  clone->cpu.SetCycles(cpu.Cycles());
+  clone->shift0 = shift0;
+  clone->shift1 = shift1;
+  clone->shiftOffset = shiftOffset;
+  clone->inputs = inputs;
+  clone->dipSwitches = dipSwitches;
+  clone->romSize = romSize;
+  clone->memHash = memHash;
+  clone->frameHash = frameHash;
+  clone->frameCount = frameCount;
+  clone->frameCycle = frameCycle;
+  clone->inputQueue = inputQueue;
+  clone->queuedInputs = queuedInputs;
+  // Frames are shared too, copied on their next capture
+  clone->display[0] = display[0];
+  clone->display[1] = display[1];
+  clone->presented = presented;
+  clone->cpu.SetEngine(cpu.GetEngine());
+
+  return clone;
+}
+
+// Every KeyboardState bit
+static const uint16_t kInputMask = COIN | P2_START | P1_START | P1_FIRE |
+                                   P1_LEFT | P1_RIGHT | TILT | P2_FIRE |
+                                   P2_LEFT | P2_RIGHT;
+
+void Bus::SetKeyboardState(KeyboardState state, bool pressed) {
+  ApplyInputs(pressed ? inputs | state : inputs & ~state);
+}
+
+void Bus::SetInputs(uint16_t states) { ApplyInputs(states); }
+
+void Bus::ApplyInputs(uint16_t states) {
+  states &= kInputMask;
+  if (inputLog != nullptr && states != inputs) {
+    *inputLog << std::dec << cpu.Cycles() << ' ' << std::hex
+              << std::setfill('0') << std::setw(4) << states << '\n';
+  }
+
+  inputs = states;
+  if (inputQueue.empty()) {
+    queuedInputs = states;
+  }
+}
+
+void Bus::SetDipSwitches(uint8_t dips) {
+  dipSwitches = dips & (DIP_LIVES | DIP_BONUS_1000 | DIP_COIN_INFO_OFF);
+}
+
+void Bus::QueueInputs(uint64_t cycle, uint16_t states) {
+  // Keep the queue sorted, an event in the past applies right away
+  cycle = std::max(cycle, inputQueue.empty() ? cpu.Cycles()
+                                             : inputQueue.back().cycle);
+  inputQueue.push_back({cycle, states});
+  queuedInputs = states;
+}
+
+void Bus::QueueKeyboardState(uint64_t cycle, KeyboardState state,
+                             bool pressed) {
+  QueueInputs(cycle, pressed ? queuedInputs | state : queuedInputs & ~state);
+}
+
+void Bus::ApplyDueInputs() {
+  while (!inputQueue.empty() && inputQueue.front().cycle <= cpu.Cycles()) {
+    ApplyInputs(inputQueue.front().states);
+    inputQueue.pop_front();
+  }
+}
+
+bool Bus::LoadInputLog(std::istream &log) {
+  uint64_t cycle;
+  uint32_t states;
+
+  while (log >> std::dec >> cycle >> std::hex >> states) {
+    QueueInputs(cycle, (uint16_t)states);
+  }
+
+  if (!log.eof()) {
+    std::cerr << "Invalid input log" << std::endl;
+    return false;
+  }
+
+  return true;
 }
 } // namespace invaders
@@ -1,48 +1,253 @@
+#include <deque>
+#include <istream>
+#include <memory>
+#include <ostream>
 #include <stdint.h>
 
+#include "audio.hpp"
 #include "config.h"
 #include "cpu.hpp"
+#include "diagnostics.hpp"
+#include "mempage.hpp"
+#include "memstats.hpp"
+#include "rom.hpp"
 
 namespace invaders {
 #pragma once
+// Input bits. The low byte is read from port 1, the high byte from port 2
 enum KeyboardState {
   COIN = 0b0000'0001,
+  P2_START = 0b0000'0010,
+  P1_START = 0b0000'0100,
+  P1_FIRE = 0b0001'0000,
   P1_LEFT = 0b0010'0000,
   P1_RIGHT = 0b0100'0000,
-  P1_FIRE = 0b0001'0000,
-  P1_START = 0b0000'0100,
+  TILT = 0b0000'0100'0000'0000,
+  P2_FIRE = 0b0001'0000'0000'0000,
+  P2_LEFT = 0b0010'0000'0000'0000,
+  P2_RIGHT = 0b0100'0000'0000'0000,
+};
+
+// DIP switch bits, read from port 2 along with the player 2 inputs
+enum DipSwitch {
+  // Ships per game minus 3
+  DIP_LIVES = 0b0000'0011,
+  // Extra ship at 1000 points instead of 1500
+  DIP_BONUS_1000 = 0b0000'1000,
+  // Hides the coin info in the attract mode
+  DIP_COIN_INFO_OFF = 0b1000'0000,
+};
+
+// Builds the DIP switch bits for 3 to 6 ships
+constexpr uint8_t MakeDipSwitches(int lives, bool bonusAt1000,
+                                  bool coinInfo) {
+  return ((lives - 3) & DIP_LIVES) | (bonusAt1000 ? DIP_BONUS_1000 : 0) |
+         (coinInfo ? 0 : DIP_COIN_INFO_OFF);
+}
+
+// Video RAM, 224 scanlines of 32 bytes. Each scanline is a column of the
+// upright display, bit 0 of its first byte being the bottom pixel
+constexpr uint16_t kVRAMStart = 0x2400;
+constexpr uint32_t kVRAMLineSize = 32;
+constexpr uint32_t kVRAMLines = 224;
+constexpr uint32_t kVRAMSize = kVRAMLines * kVRAMLineSize;
+
+// A displayed frame, shared copy-on-write between a bus and its clones like
+// the memory pages
+struct VRAMFrame {
+  uint8_t data[kVRAMSize] = {0};
 };
 
 #pragma once
 class Bus {
+  // Instantiated per diagnostics combination, see BindCPU
+  template <bool LogWrites, bool Count>
   void WriteMem(uint16_t addr, uint8_t data);
-  uint8_t ReadMem(uint16_t addr);
+  template <bool Count> uint8_t ReadMem(uint16_t addr);
 
-  void WriteIO(uint8_t port, uint8_t data);
-  uint8_t ReadIO(uint8_t port);
+  template <bool Count> void WriteIO(uint8_t port, uint8_t data);
+  template <bool Count> uint8_t ReadIO(uint8_t port);
 
   // Shift register state
-  uint16_t shift0;
-  uint16_t shift1;
-  uint16_t shiftOffset;
+  uint16_t shift0 = 0;
+  uint16_t shift1 = 0;
+  uint16_t shiftOffset = 0;
+
+  // KeyboardState bits
+  uint16_t inputs = 0;
+  // DipSwitch bits, kept across resets like the real switches
+  uint8_t dipSwitches = 0;
+
+  // Inputs waiting for their cycle, sorted by cycle
+  struct InputEvent {
+    uint64_t cycle;
+    uint16_t states;
+  };
+  std::deque<InputEvent> inputQueue;
+  // Inputs once every queued event is applied
+  uint16_t queuedInputs = 0;
+  std::ostream *inputLog = nullptr;
+
+  void ApplyInputs(uint16_t states);
+  void ApplyDueInputs();
+
+  // Receives the sound port writes
+  Audio *audio = nullptr;
+
+  // Writes below this address are ignored
+  uint16_t romSize = 0x2000;
+
+  // Memory is split into pages which are shared copy-on-write between a bus,
+  // its clones and the ROM image. A page is only copied the first time it
+  // gets written
+  static constexpr int kPageBits = kMemPageBits;
+  static constexpr uint32_t kPageSize = kMemPageSize;
+  static constexpr int kPageCount = kMemPageCount;
 
-  uint8_t port1 = 0;
+  std::shared_ptr<MemPage> pages[kPageCount];
+  // Raw data of `pages`, read directly by the CPU's fast engine
+  const uint8_t *pageData[kPageCount];
+  // Bitmask of the pages which are exclusively owned and writable in place
+  uint64_t ownedPages = 0;
+  static_assert(kPageCount <= 64, "ownedPages can only track 64 pages");
+
+  // Returns the page containing `addr`, copying it first if it is shared
+  MemPage &WritablePage(uint16_t addr);
+
+  // Running hash of the whole address space, kept up to date by WriteMem
+  uint64_t memHash = 0;
+  // State hash sampled at the last vblank interrupt
+  uint64_t frameHash = 0;
+  uint64_t frameCount = 0;
+  std::ostream *hashLog = nullptr;
+
+  // Cycles run since the start of the current frame
+  uint32_t frameCycle = 0;
+
+  // Displayed VRAM, double buffered. `display[presented]` is the last
+  // complete frame, the other one is being captured
+  std::shared_ptr<VRAMFrame> display[2];
+  int presented = 0;
+
+  // Returns display[index], copying it first if it is shared
+  VRAMFrame &WritableFrame(int index);
+
+  // Copies scanlines of the live VRAM into the frame being captured
+  void CaptureLines(uint32_t first, uint32_t count);
+  // Makes both frames show the live VRAM, after it changed outside of Run
+  void ResetDisplay();
+
+  uint32_t diagnostics = DIAG_NONE;
+  MemoryStats *memoryStats = nullptr;
+
+  void VBlank();
+  // Binds the CPU to the bus callbacks matching the enabled diagnostics
+  void BindCPU();
+  template <bool Count> void BindCPUWith(bool logWrites);
 
 public:
   CPU cpu;
 
   bool LoadFileAt(const std::string path, const uint16_t start);
+  // Maps a ROM image at 0x0000. Its pages are shared with every other bus
+  // running the same image until they get written
+  void LoadROM(const std::shared_ptr<const ROM> &rom);
+  // Loads the image through the ROM cache, see invaders::LoadROM()
+  bool LoadROM(const std::string &path);
+  // Copies `size` bytes from memory to `start`. Fails if the data does not
+  // fit in the address space
+  bool LoadAt(const uint8_t *data, size_t size, const uint16_t start);
 
   // CPU
   void Reset();
   void TickCPU();
+  // Runs a full frame: both half frames with the mid-screen (RST 1) and vblank
+  // (RST 2) interrupts
+  void RunFrame() { Run(kFrameCycles); }
+  // Runs `cycles` cycles, raising the screen interrupts whenever the frame
+  // position crosses them. Any split of a frame into Run calls behaves the
+  // same as RunFrame
+  void Run(uint32_t cycles);
+  // Cycles run since the start of the current frame
+  uint32_t FrameCycle() const { return frameCycle; }
 
-  // IO
+  // VRAM as the beam drew it, kVRAMSize bytes. The game only redraws the
+  // half of the screen the beam is not on, so the first half of the
+  // scanlines is captured at the mid-screen interrupt and the second at
+  // vblank, which publishes the frame. Unlike live VRAM it never tears, and
+  // it stays unchanged until the next vblank
+  const uint8_t *DisplayFrame() const { return display[presented]->data; }
+
+  // Cycles executed between the two screen interrupts
+  static constexpr int kHalfFrameCycles = 16'500;
+  static constexpr int kFrameCycles = kHalfFrameCycles * 2;
+
+  // State hashing. The hash covers the CPU registers, the whole memory and
+  // the IO latches. It is sampled on every vblank interrupt
+  uint64_t StateHash() const;
+  uint64_t FrameHash() const { return frameHash; }
+  uint64_t FrameCount() const { return frameCount; }
+  // Logs "<frame> <hash>" on every vblank. Pass nullptr to disable
+  void SetHashLog(std::ostream *log) { hashLog = log; }
+  // Recomputes the memory hash from scratch
+  void RehashMemory();
+
+  // Enables a set of Diagnostics values on the bus and the CPU
+  void SetDiagnostics(uint32_t diagnostics);
+  uint32_t GetDiagnostics() const { return diagnostics; }
+  // Counts memory and IO accesses into `stats` when DIAG_MEM_STATS is
+  // enabled. Pass nullptr to detach
+  void SetMemoryStats(MemoryStats *stats);
+
+  // Queues sound port writes and the emulated time into `audio`. Pass nullptr
+  // to detach
+  void SetAudio(Audio *audio) { this->audio = audio; }
+
+  // IO. The Set functions apply right away, the Queue functions at the given
+  // CPU cycle (see CPU::Cycles()) while running. Queued inputs build on each
+  // other, so mixing both only makes sense between queued events
   void SetKeyboardState(KeyboardState state, bool pressed);
+  // Sets all inputs at once from a bitmask of KeyboardState values
+  void SetInputs(uint16_t states);
+  void QueueKeyboardState(uint64_t cycle, KeyboardState state, bool pressed);
+  void QueueInputs(uint64_t cycle, uint16_t states);
+  uint16_t Inputs() const { return inputs; }
+  // Bitmask of DipSwitch values, see MakeDipSwitches()
+  void SetDipSwitches(uint8_t dips);
+  uint8_t DipSwitches() const { return dipSwitches; }
+  // Logs "<cycle> <inputs>" whenever the inputs change, replayable with
+  // LoadInputLog(). Pass nullptr to disable
+  void SetInputLog(std::ostream *log) { inputLog = log; }
+  // Queues every event of an input log
+  bool LoadInputLog(std::istream &log);
+
+  // Size of the write protected ROM at the start of the address space. 0
+  // makes all memory writable (CP/M programs)
+  void SetROMSize(uint16_t size) { romSize = size; }
+  uint16_t ROMSize() const { return romSize; }
+
+  // Memory access from outside the CPU. Poke ignores the ROM write protection
+  uint8_t Peek(uint16_t addr) const {
+    return pages[addr >> kPageBits]->data[addr & (kPageSize - 1)];
+  }
+  void Poke(uint16_t addr, uint8_t data);
+  // Copies `len` bytes starting at `start` into `dst`
+  void CopyMem(uint16_t start, uint8_t *dst, uint32_t len) const;
+
+  // Save states are a flat, versioned and endian independent blob of
+  // kStateSize bytes
+  static const size_t kStateSize;
+  void SaveState(uint8_t *dst) const;
+  // Returns false if `src` is not a valid state
+  bool LoadState(const uint8_t *src, size_t size);
 
-  // Keep the full addressable range as memory for now
-  uint8_t mem[1 << 16] = {0};
+  // Returns a copy of the whole machine. Memory pages and displayed frames
+  // are shared with this bus until either side writes them, so a clone costs
+  // O(pages written) instead of a copy of the 64 KiB address space
+  std::unique_ptr<Bus> Clone();
 
   Bus();
+  Bus(const Bus &) = delete;
+  Bus &operator=(const Bus &) = delete;
 };
 } // namespace invaders
@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "capture.hpp"
+#include "png.hpp"
+
+namespace invaders {
+FrameCapture::FrameCapture(int threads, size_t capacity)
+    : capacity(capacity < 1 ? 1 : capacity) {
+  if (threads < 1) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  for (int i = 0; i < threads; ++i) {
+    workers.emplace_back(&FrameCapture::WorkerLoop, this);
+  }
+}
+
+FrameCapture::~FrameCapture() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  queued.notify_all();
+
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+bool FrameCapture::Submit(const std::string path, const uint8_t *rgb,
+                          int width, int height, bool wait) {
+  std::unique_lock<std::mutex> lock(mutex);
+
+  if (jobs.size() >= capacity) {
+    if (!wait) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    done.wait(lock, [this]() { return jobs.size() < capacity; });
+  }
+
+  jobs.push_back({path, std::vector<uint8_t>(rgb, rgb + width * height * 3),
+                  width, height});
+  ++pending;
+  lock.unlock();
+
+  queued.notify_one();
+  return true;
+}
+
+std::string FrameCapture::FramePath(const std::string &dir,
+                                    const std::string &prefix,
+                                    uint64_t frame) {
+  char name[32];
+  snprintf(name, sizeof(name), "-%08llu.png", (unsigned long long)frame);
+  return (dir.empty() ? "" : dir + "/") + prefix + name;
+}
+
+void FrameCapture::Wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [this]() { return pending == 0; });
+}
+
+void FrameCapture::WorkerLoop() {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      // Finish the queued jobs before stopping
+      queued.wait(lock, [this]() { return stopping || !jobs.empty(); });
+      if (jobs.empty()) {
+        return;
+      }
+
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+
+    if (WritePNG(job.path, job.rgb.data(), job.width, job.height)) {
+      written.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      failed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      --pending;
+    }
+    done.notify_all();
+  }
+}
+} // namespace invaders
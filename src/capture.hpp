@@ -0,0 +1,65 @@
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace invaders {
+#pragma once
+// Writes frames as PNG files on a pool of worker threads. Submitting only
+// copies the frame, so screenshots and long frame sequences never stall the
+// emulation on compression or I/O
+class FrameCapture {
+  struct Job {
+    std::string path;
+    std::vector<uint8_t> rgb;
+    int width;
+    int height;
+  };
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  // Signaled when a job is queued or on shutdown
+  std::condition_variable queued;
+  // Signaled when a job is done
+  std::condition_variable done;
+  std::deque<Job> jobs;
+  size_t capacity;
+  size_t pending = 0;
+  bool stopping = false;
+
+  std::atomic<uint64_t> written{0};
+  std::atomic<uint64_t> failed{0};
+  std::atomic<uint64_t> dropped{0};
+
+  void WorkerLoop();
+
+public:
+  // `threads` defaults to the number of cores. At most `capacity` frames
+  // wait for a worker at once
+  explicit FrameCapture(int threads = 0, size_t capacity = 256);
+  ~FrameCapture();
+
+  FrameCapture(const FrameCapture &) = delete;
+  FrameCapture &operator=(const FrameCapture &) = delete;
+
+  // Queues a copy of an RGB888 frame. Returns false if the frame was dropped
+  // because the queue is full, or with `wait` waits for room instead
+  bool Submit(const std::string path, const uint8_t *rgb, int width,
+              int height, bool wait = false);
+  // "<dir>/<prefix>-<frame>.png", with the frame zero padded so files sort
+  static std::string FramePath(const std::string &dir,
+                               const std::string &prefix, uint64_t frame);
+  // Blocks until every queued frame is written
+  void Wait();
+
+  size_t Threads() const { return workers.size(); }
+  uint64_t Written() const { return written.load(); }
+  uint64_t Failed() const { return failed.load(); }
+  uint64_t Dropped() const { return dropped.load(); }
+};
+} // namespace invaders
@@ -0,0 +1,134 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#include "checksum.hpp"
+
+namespace invaders {
+namespace {
+struct Crc32Table {
+  uint32_t entries[256];
+
+  Crc32Table() {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int bit = 0; bit < 8; ++bit) {
+        c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+      }
+      entries[i] = c;
+    }
+  }
+};
+
+inline uint32_t RotateLeft(uint32_t x, int n) {
+  return (x << n) | (x >> (32 - n));
+}
+
+void Sha1Block(uint32_t state[5], const uint8_t *block) {
+  uint32_t w[80];
+  for (int i = 0; i < 16; ++i) {
+    w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 |
+           (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+  }
+  for (int i = 16; i < 80; ++i) {
+    w[i] = RotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+  }
+
+  auto a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+  for (int i = 0; i < 80; ++i) {
+    uint32_t f, k;
+    if (i < 20) {
+      f = (b & c) | (~b & d);
+      k = 0x5a827999;
+    } else if (i < 40) {
+      f = b ^ c ^ d;
+      k = 0x6ed9eba1;
+    } else if (i < 60) {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8f1bbcdc;
+    } else {
+      f = b ^ c ^ d;
+      k = 0xca62c1d6;
+    }
+
+    auto t = RotateLeft(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = RotateLeft(b, 30);
+    b = a;
+    a = t;
+  }
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+}
+} // namespace
+
+uint32_t Crc32(const uint8_t *data, size_t size, uint32_t crc) {
+  static const Crc32Table table;
+
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i) {
+    crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+uint32_t Adler32(const uint8_t *data, size_t size, uint32_t adler) {
+  uint32_t a = adler & 0xffff, b = adler >> 16;
+
+  while (size > 0) {
+    // Largest run which cannot overflow before the modulo
+    auto chunk = size < 5552 ? size : 5552;
+    size -= chunk;
+    for (size_t i = 0; i < chunk; ++i) {
+      a += data[i];
+      b += a;
+    }
+    data += chunk;
+    a %= 65521;
+    b %= 65521;
+  }
+
+  return (b << 16) | a;
+}
+
+std::string Sha1(const uint8_t *data, size_t size) {
+  uint32_t state[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476,
+                       0xc3d2e1f0};
+
+  size_t offset = 0;
+  for (; offset + 64 <= size; offset += 64) {
+    Sha1Block(state, data + offset);
+  }
+
+  // Padding: a 1 bit, zeroes and the message length in bits, big endian
+  uint8_t tail[128] = {0};
+  auto rest = size - offset;
+  memcpy(tail, data + offset, rest);
+  tail[rest] = 0x80;
+
+  auto tailSize = rest < 56 ? 64 : 128;
+  uint64_t bits = (uint64_t)size * 8;
+  for (int i = 0; i < 8; ++i) {
+    tail[tailSize - 1 - i] = (bits >> (i * 8)) & 0xff;
+  }
+
+  Sha1Block(state, tail);
+  if (tailSize == 128) {
+    Sha1Block(state, tail + 64);
+  }
+
+  char hex[41];
+  for (int i = 0; i < 5; ++i) {
+    snprintf(hex + i * 8, 9, "%08x", state[i]);
+  }
+  return hex;
+}
+} // namespace invaders
@@ -0,0 +1,17 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace invaders {
+#pragma once
+// CRC-32 (IEEE 802.3, as used by zip and PNG). Pass the previous result as
+// `crc` to checksum data in pieces
+uint32_t Crc32(const uint8_t *data, size_t size, uint32_t crc = 0);
+
+// Adler-32 (as used by zlib). Pass the previous result as `adler` to
+// checksum data in pieces
+uint32_t Adler32(const uint8_t *data, size_t size, uint32_t adler = 1);
+
+// SHA-1 of `data` as a lowercase hex string
+std::string Sha1(const uint8_t *data, size_t size);
+} // namespace invaders
@@ -4,12 +4,68 @@
 #include <stdint.h>
 
 #include "cpu.hpp"
+#include "diagnostics.hpp"
 #include "utils.hpp"
 
 namespace invaders {
 CPU::CPU(ReadBusFunction readBus, WriteBusFunction writeBus,
          ReadIOFunction readIO, WriteIOFunction writeIO)
-    : ReadBus(readBus), WriteBus(writeBus), ReadIO(readIO), WriteIO(writeIO) {}
+    : ReadBus(readBus), WriteBus(writeBus), ReadIO(readIO), WriteIO(writeIO) {
+  SelectRunFunction();
+}
+
+void CPU::SetBusFunctions(ReadBusFunction readBus, WriteBusFunction writeBus,
+                          ReadIOFunction readIO, WriteIOFunction writeIO) {
+  ReadBus = readBus;
+  WriteBus = writeBus;
+  ReadIO = readIO;
+  WriteIO = writeIO;
+}
+
+void CPU::SetDiagnostics(uint32_t diagnostics) {
+  this->diagnostics = diagnostics;
+  SelectRunFunction();
+}
+
+void CPU::SetTracer(Tracer *tracer) {
+  this->tracer = tracer;
+  SelectRunFunction();
+}
+
+void CPU::SetProfiler(Profiler *profiler) {
+  this->profiler = profiler;
+  SelectRunFunction();
+}
+
+void CPU::SetEngine(Engine engine) {
+  this->engine = engine;
+  SelectRunFunction();
+}
+
+void CPU::SetMemoryPages(const uint8_t *const *pages, int pageBits) {
+  memoryPages = pages;
+  this->pageBits = pageBits;
+  pageMask = (1 << pageBits) - 1;
+  SelectRunFunction();
+}
+
+void CPU::SelectRunFunction() {
+  static const auto table = MakeRunTable(
+      std::make_integer_sequence<uint32_t, kFastEngine << 1>());
+
+  auto enabled = diagnostics & kCPUDiagnosticsMask;
+  if (tracer == nullptr) {
+    enabled &= ~DIAG_TRACE_CPU;
+  }
+  if (profiler == nullptr) {
+    enabled &= ~DIAG_PROFILE;
+  }
+  if (engine == ENGINE_FAST && memoryPages != nullptr) {
+    enabled |= kFastEngine;
+  }
+
+  runFunction = table[enabled];
+}
 
 void CPU::Reset() {
   pc = 0;
@@ -21,8 +77,32 @@ void CPU::Reset() {
   e = 0;
   h = 0;
   l = 0;
+  flags.all = 0;
   interrupts = true;
   pendingCycles = 0;
+  cycleCount = 0;
+  instructionCount = 0;
+  cpmExited = false;
+  cpmFailed = false;
+}
+
+CPU::Registers CPU::GetRegisters() const {
+  return {pc, sp, a, b, c, d, e, h, l, flags.all, pendingCycles, interrupts};
+}
+
+void CPU::SetRegisters(const Registers &regs) {
+  pc = regs.pc;
+  sp = regs.sp;
+  a = regs.a;
+  b = regs.b;
+  c = regs.c;
+  d = regs.d;
+  e = regs.e;
+  h = regs.h;
+  l = regs.l;
+  flags.all = regs.flags;
+  pendingCycles = regs.pendingCycles;
+  interrupts = regs.interrupts;
 }
 
 inline int CPU::Parity(int x, int size) {
@@ -62,6 +142,15 @@ inline void CPU::UnimplementedOpcode(uint8_t opcode) {
   TRACE("Unimplemented Opcode");
 }
 
+template <uint32_t Diag> inline uint8_t CPU::Read(uint16_t addr) {
+  if constexpr ((Diag & kFastEngine) != 0) {
+    return memoryPages[addr >> pageBits][addr & pageMask];
+  } else {
+    return ReadBus(addr);
+  }
+}
+
+template <uint32_t Diag>
 inline uint8_t CPU::GetOperand8_0(uint8_t opcode) {
 
   // Match with the second nibbe
@@ -72,12 +161,13 @@ inline uint8_t CPU::GetOperand8_0(uint8_t opcode) {
   case 3: return e;
   case 4: return h;
   case 5: return l;
-  case 6: return ReadBus(GetHL());
+  case 6: return Read<Diag>(GetHL());
   case 7: return a;
   default: PANIC("Impossible state");
   }
 }
 
+template <uint32_t Diag>
 inline uint8_t CPU::GetOperand8_1(uint8_t opcode) {
   // Match with the first nibble
   switch (opcode & 0x07) {
@@ -87,7 +177,7 @@ inline uint8_t CPU::GetOperand8_1(uint8_t opcode) {
   case 3: return e;
   case 4: return h;
   case 5: return l;
-  case 6: return ReadBus(GetHL());
+  case 6: return Read<Diag>(GetHL());
   case 7: return a;
   default: PANIC("Impossible state");
   }
@@ -184,8 +274,9 @@ inline void CPU::StackPush(uint16_t data) {
   sp -= 2;
 }
 
-inline uint16_t CPU::StackPop() {
-  uint16_t ret = (uint16_t)ReadBus(sp) | ((uint16_t)ReadBus(sp + 1) << 8);
+template <uint32_t Diag> inline uint16_t CPU::StackPop() {
+  uint16_t ret =
+      (uint16_t)Read<Diag>(sp) | ((uint16_t)Read<Diag>(sp + 1) << 8);
   sp += 2;
   return ret;
 }
@@ -204,12 +295,7 @@ inline uint16_t CPU::GetRSTAddr(uint8_t opcode) {
   }
 }
 
-void CPU::ExecuteOpcode(uint8_t opcode) {
-#ifdef PRINT_CPU_STATUS
-  std::cout << "Executing: 0x" << std::hex << std::setfill('0') << std::setw(2)
-            << +opcode << " at PC: 0x" << std::setw(4) << pc - 1 << std::endl;
-#endif
-
+template <uint32_t Diag> void CPU::ExecuteOpcode(uint8_t opcode) {
   this->opcode = opcode;
 
   switch (opcode) {
@@ -232,7 +318,7 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   case 0x71: case 0x72: case 0x73: case 0x74: case 0x75: case 0x77: case 0x78:
   case 0x79: case 0x7A: case 0x7B: case 0x7C: case 0x7D: case 0x7E: case 0x7F: {
     // clang-format on
-    SetOperand8_0(opcode, GetOperand8_1(opcode));
+    SetOperand8_0(opcode, GetOperand8_1<Diag>(opcode));
   } break;
 
   // ADD operand
@@ -241,7 +327,7 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   case 0x87: {
     // clang-format on
     // Use higher precision for easier flag calculation
-    uint16_t res = (uint16_t)a + (uint16_t)GetOperand8_1(opcode);
+    uint16_t res = (uint16_t)a + (uint16_t)GetOperand8_1<Diag>(opcode);
     ArithFlagsA(res);
     a = res & 0xff;
   } break;
@@ -252,7 +338,7 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   case 0x8f: {
     // clang-format on
     // Use higher precision for easier flag calculation
-    uint16_t res = (uint16_t)a + (uint16_t)GetOperand8_1(opcode) + flags.cy;
+    uint16_t res = (uint16_t)a + (uint16_t)GetOperand8_1<Diag>(opcode) + flags.cy;
     ArithFlagsA(res);
     a = res & 0xff;
   } break;
@@ -263,7 +349,7 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   case 0x97: {
     // clang-format on
     // Use higher precision for easier flag calculation
-    uint16_t res = (uint16_t)a - (uint16_t)GetOperand8_1(opcode);
+    uint16_t res = (uint16_t)a - (uint16_t)GetOperand8_1<Diag>(opcode);
     ArithFlagsA(res);
     a = res & 0xff;
   } break;
@@ -274,7 +360,7 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   case 0x9f: {
     // clang-format on
     // Use higher precision for easier flag calculation
-    uint16_t res = (uint16_t)a - (uint16_t)GetOperand8_1(opcode) - flags.cy;
+    uint16_t res = (uint16_t)a - (uint16_t)GetOperand8_1<Diag>(opcode) - flags.cy;
     ArithFlagsA(res);
     a = res & 0xff;
   } break;
@@ -284,7 +370,7 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   case 0xa0: case 0xa1: case 0xa2: case 0xa3: case 0xa4: case 0xa5: case 0xa6:
   case 0xa7: {
     // clang-format on
-    a &= GetOperand8_1(opcode);
+    a &= GetOperand8_1<Diag>(opcode);
     LogicFlagsA();
   } break;
 
@@ -293,7 +379,7 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   case 0xa8: case 0xa9: case 0xaa: case 0xab: case 0xac: case 0xad: case 0xae:
   case 0xaf: {
     // clang-format on
-    a ^= GetOperand8_1(opcode);
+    a ^= GetOperand8_1<Diag>(opcode);
     LogicFlagsA();
   } break;
 
@@ -302,7 +388,7 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   case 0xb0: case 0xb1: case 0xb2: case 0xb3: case 0xb4: case 0xb5: case 0xb6:
   case 0xb7: {
     // clang-format on
-    a |= GetOperand8_1(opcode);
+    a |= GetOperand8_1<Diag>(opcode);
     LogicFlagsA();
   } break;
 
@@ -312,7 +398,7 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   case 0xbf: {
     // clang-format on
     // Use higher precision for easier flag calculation
-    uint16_t res = (uint16_t)a - (uint16_t)GetOperand8_1(opcode);
+    uint16_t res = (uint16_t)a - (uint16_t)GetOperand8_1<Diag>(opcode);
     ArithFlagsA(res);
   } break;
 
@@ -321,7 +407,7 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   case 0x06: case 0x0E: case 0x16: case 0x1E: case 0x26: case 0x2E: case 0x36:
   case 0x3E: {
     // clang-format on
-    SetOperand8_0(opcode, ReadBus(pc));
+    SetOperand8_0(opcode, Read<Diag>(pc));
     ++pc;
   } break;
 
@@ -330,7 +416,7 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   case 0x04: case 0x0c: case 0x14: case 0x1c: case 0x24: case 0x2c: case 0x34:
   case 0x3c: {
     // clang-format on
-    uint8_t result = GetOperand8_0(opcode) + 1;
+    uint8_t result = GetOperand8_0<Diag>(opcode) + 1;
     SetOperand8_0(opcode, result);
     ArithFlagsA(result, false);
   } break;
@@ -340,7 +426,7 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   case 0x05: case 0x0d: case 0x15: case 0x1d: case 0x25: case 0x2d: case 0x35:
   case 0x3d: {
     // clang-format on
-    uint8_t result = GetOperand8_0(opcode) - 1;
+    uint8_t result = GetOperand8_0<Diag>(opcode) - 1;
     SetOperand8_0(opcode, result);
     ArithFlagsA(result, false);
   } break;
@@ -375,7 +461,7 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   // clang-format off
   case 0x01: case 0x11: case 0x21: case 0x31: {
     // clang-format on
-    SetRP(opcode, ReadBus(pc), ReadBus(pc + 1));
+    SetRP(opcode, Read<Diag>(pc), Read<Diag>(pc + 1));
     pc += 2;
   } break;
 
@@ -388,7 +474,8 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
 
   // SHLD u16
   case 0x22: {
-    uint16_t offset = (uint16_t)ReadBus(pc) | ((uint16_t)ReadBus(pc + 1) << 8);
+    uint16_t offset =
+        (uint16_t)Read<Diag>(pc) | ((uint16_t)Read<Diag>(pc + 1) << 8);
     WriteBus(offset, l);
     WriteBus(offset + 1, h);
     pc += 2;
@@ -396,7 +483,8 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
 
   // STA u16
   case 0x32: {
-    uint16_t offset = (uint16_t)ReadBus(pc) | ((uint16_t)ReadBus(pc + 1) << 8);
+    uint16_t offset =
+        (uint16_t)Read<Diag>(pc) | ((uint16_t)Read<Diag>(pc + 1) << 8);
     WriteBus(offset, a);
     pc += 2;
   } break;
@@ -405,21 +493,23 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   // clang-format off
   case 0x0a: case 0x1a: {
     // clang-format on
-    a = ReadBus(GetRP(opcode));
+    a = Read<Diag>(GetRP(opcode));
   } break;
 
   // LHLD u16
   case 0x2a: {
-    uint16_t offset = (uint16_t)ReadBus(pc) | ((uint16_t)ReadBus(pc + 1) << 8);
-    l = ReadBus(offset);
-    h = ReadBus(offset + 1);
+    uint16_t offset =
+        (uint16_t)Read<Diag>(pc) | ((uint16_t)Read<Diag>(pc + 1) << 8);
+    l = Read<Diag>(offset);
+    h = Read<Diag>(offset + 1);
     pc += 2;
   } break;
 
   // LDA u16
   case 0x3a: {
-    uint16_t offset = (uint16_t)ReadBus(pc) | ((uint16_t)ReadBus(pc + 1) << 8);
-    a = ReadBus(offset);
+    uint16_t offset =
+        (uint16_t)Read<Diag>(pc) | ((uint16_t)Read<Diag>(pc + 1) << 8);
+    a = Read<Diag>(offset);
     pc += 2;
   } break;
 
@@ -487,7 +577,7 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
     // clang-format on
     if (BranchCondition(opcode)) {
       // TODO: confirm
-      pc = ((uint16_t)ReadBus(pc + 1) << 8) | (uint16_t)ReadBus(pc);
+      pc = ((uint16_t)Read<Diag>(pc + 1) << 8) | (uint16_t)Read<Diag>(pc);
     } else {
       pc += 2;
     }
@@ -496,7 +586,7 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   // JMP u16
   case 0xc3: {
     // TODO: confirm
-    pc = ((uint16_t)ReadBus(pc + 1) << 8) | (uint16_t)ReadBus(pc);
+    pc = ((uint16_t)Read<Diag>(pc + 1) << 8) | (uint16_t)Read<Diag>(pc);
   } break;
 
   // CALL condition,u16 (CZ u16, CPE u16, etc)
@@ -505,8 +595,15 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   case 0xfc: {
     // clang-format on
     if (BranchCondition(opcode)) {
+      // The target is read before the push, which may overwrite it
+      uint16_t target =
+          ((uint16_t)Read<Diag>(pc + 1) << 8) | (uint16_t)Read<Diag>(pc);
       StackPush(pc + 2);
-      pc = ((uint16_t)ReadBus(pc + 1) << 8) | (uint16_t)ReadBus(pc);
+      pc = target;
+
+      if constexpr ((Diag & DIAG_PROFILE) != 0) {
+        profiler->Call(pc, sp);
+      }
     } else {
       pc += 2;
     }
@@ -514,34 +611,14 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
 
   // CALL u16
   case 0xcd: {
-#ifdef CPM_EMU
-    // Adapted from http://www.emulator101.com/full-8080-emulation.html
-    if ((((uint16_t)ReadBus(pc + 1) << 8) | (uint16_t)ReadBus(pc)) == 5 ||
-        c == 9) {
-      if (c == 9) {
-        uint16_t offset = (d << 8) | e;
-
-        uint8_t i = 0;
-        char str = ReadBus(offset + i);
-        while (str != '$') {
-          printf("%c", str);
-          ++i;
-          str = ReadBus(offset + i);
-        }
-        printf("\n");
-      } else if (c == 2) {
-        printf("print char routine called\n");
-      }
-    } else if (c == 5 || c == 9) {
-      printf("%c\n", e);
-    } else if ((((uint16_t)ReadBus(pc + 1) << 8) | (uint16_t)ReadBus(pc)) ==
-               0) {
-      exit(0);
-    }
-#endif
-
+    uint16_t target =
+        ((uint16_t)Read<Diag>(pc + 1) << 8) | (uint16_t)Read<Diag>(pc);
     StackPush(pc + 2);
-    pc = ((uint16_t)ReadBus(pc + 1) << 8) | (uint16_t)ReadBus(pc);
+    pc = target;
+
+    if constexpr ((Diag & DIAG_PROFILE) != 0) {
+      profiler->Call(pc, sp);
+    }
   } break;
 
   // RET condition,u16 (RZ u16, RPE u16, etc)
@@ -550,13 +627,21 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   case 0xf8: {
     // clang-format on
     if (BranchCondition(opcode)) {
-      pc = StackPop();
+      pc = StackPop<Diag>();
+
+      if constexpr ((Diag & DIAG_PROFILE) != 0) {
+        profiler->Return(sp);
+      }
     }
   } break;
 
   // RET u16
   case 0xc9: {
-    pc = StackPop();
+    pc = StackPop<Diag>();
+
+    if constexpr ((Diag & DIAG_PROFILE) != 0) {
+      profiler->Return(sp);
+    }
   } break;
 
   // PUSH operand
@@ -570,13 +655,13 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   // clang-format off
   case 0xc1: case 0xd1: case 0xe1: case 0xf1: {
     // clang-format on
-    SetStackRP(opcode, StackPop());
+    SetStackRP(opcode, StackPop<Diag>());
   } break;
 
   // ADI u8
   case 0xc6: {
     // Use higher precision for easier flag calculation
-    uint16_t res = (uint16_t)a + (uint16_t)ReadBus(pc);
+    uint16_t res = (uint16_t)a + (uint16_t)Read<Diag>(pc);
     ++pc;
     ArithFlagsA(res);
     a = res & 0xff;
@@ -585,7 +670,7 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   // ACI u8
   case 0xce: {
     // Use higher precision for easier flag calculation
-    uint16_t res = (uint16_t)a + (uint16_t)ReadBus(pc) + flags.cy;
+    uint16_t res = (uint16_t)a + (uint16_t)Read<Diag>(pc) + flags.cy;
     ++pc;
     ArithFlagsA(res);
     a = res & 0xff;
@@ -594,7 +679,7 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   // SUI u8
   case 0xd6: {
     // Use higher precision for easier flag calculation
-    uint16_t res = (uint16_t)a - (uint16_t)ReadBus(pc);
+    uint16_t res = (uint16_t)a - (uint16_t)Read<Diag>(pc);
     ++pc;
     ArithFlagsA(res);
     a = res & 0xff;
@@ -603,7 +688,7 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   // ABI u8
   case 0xde: {
     // Use higher precision for easier flag calculation
-    uint16_t res = (uint16_t)a - (uint16_t)ReadBus(pc) - flags.cy;
+    uint16_t res = (uint16_t)a - (uint16_t)Read<Diag>(pc) - flags.cy;
     ++pc;
     ArithFlagsA(res);
     a = res & 0xff;
@@ -611,21 +696,21 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
 
   // ANI u8
   case 0xe6: {
-    a &= ReadBus(pc);
+    a &= Read<Diag>(pc);
     ++pc;
     LogicFlagsA();
   } break;
 
   // XRI u8
   case 0xee: {
-    a ^= ReadBus(pc);
+    a ^= Read<Diag>(pc);
     ++pc;
     LogicFlagsA();
   } break;
 
   // ORI u8
   case 0xf6: {
-    a |= ReadBus(pc);
+    a |= Read<Diag>(pc);
     ++pc;
     LogicFlagsA();
   } break;
@@ -633,7 +718,7 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   // CPI u8
   case 0xfe: {
     // Use higher precision for easier flag calculation
-    uint16_t res = (uint16_t)a - (uint16_t)ReadBus(pc);
+    uint16_t res = (uint16_t)a - (uint16_t)Read<Diag>(pc);
     ArithFlagsA(res);
     ++pc;
   } break;
@@ -643,8 +728,13 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   case 0xc7: case 0xcf: case 0xd7: case 0xdf: case 0xe7: case 0xef: case 0xf7:
   case 0xff: {
     // clang-format on
-    StackPush(pc + 2);
+    // pc already points past the single byte instruction
+    StackPush(pc);
     pc = GetRSTAddr(opcode);
+
+    if constexpr ((Diag & DIAG_PROFILE) != 0) {
+      profiler->Call(pc, sp);
+    }
   } break;
 
   // XCHG
@@ -665,7 +755,7 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   // XTHL
   case 0xe3: {
     uint16_t tmp = GET_RP(h, l);
-    SET_RP(h, l, StackPop());
+    SET_RP(h, l, StackPop<Diag>());
     StackPush(tmp);
   } break;
 
@@ -681,26 +771,20 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
 
   // OUT d8
   case 0xd3: {
-    uint8_t port = ReadBus(pc);
+    uint8_t port = Read<Diag>(pc);
     ++pc;
 
-    if (port >= 8) {
-      PANIC("I/O port out of bounds");
-    } else {
-      WriteIO(port, a);
-    }
+    // Port decoding is up to the bus
+    WriteIO(port, a);
   } break;
 
   // IN d8
   case 0xdb: {
-    uint8_t port = ReadBus(pc);
+    uint8_t port = Read<Diag>(pc);
     ++pc;
 
-    if (port >= 8) {
-      PANIC("I/O port out of bounds");
-    } else {
-      a = ReadIO(port);
-    }
+    // Port decoding is up to the bus
+    a = ReadIO(port);
   } break;
 
   // PCHL
@@ -714,27 +798,106 @@ void CPU::ExecuteOpcode(uint8_t opcode) {
   }
 }
 
-void CPU::Tick() {
-  if (pendingCycles != 0) {
-    --pendingCycles;
-  } else {
-    uint8_t opcode = ReadBus(pc);
-    pendingCycles = cycles[opcode] - 1;
-    pc += 1;
-    ExecuteOpcode(opcode);
+template <uint32_t Diag> inline void CPU::Step() {
+  uint8_t opcode = Read<Diag>(pc);
+
+  if constexpr ((Diag & DIAG_TRACE_CPU) != 0) {
+    tracer->Record({cycleCount, pc, sp, opcode, a, b, c, d, e, h, l,
+                    flags.all, 0, {0, 0}});
+  }
+  if constexpr ((Diag & DIAG_PROFILE) != 0) {
+    profiler->Instruction(pc, cycles[opcode]);
+  }
+
+  pendingCycles = cycles[opcode] - 1;
+  ++cycleCount;
+  ++instructionCount;
+  pc += 1;
+  ExecuteOpcode<Diag>(opcode);
+}
+
+void CPU::Tick() { Run(1); }
+
+bool CPU::BDOSCall() {
+  auto &out = console != nullptr ? *console : std::cout;
+
+  switch (c) {
+  // C_WRITE, character in E
+  case 2: out.put(e); break;
+  // C_WRITESTR, '$' terminated string at DE
+  case 9: {
+    auto addr = GET_RP(d, e);
+    // Look for the end first, memory might not hold a '$' at all
+    uint32_t length = 0;
+    while (length < 0x10000 && ReadBus((uint16_t)(addr + length)) != '$') {
+      ++length;
+    }
+    if (length == 0x10000) {
+      std::cerr << "BDOS C_WRITESTR: no '$' ends the string at 0x" << std::hex
+                << std::setw(4) << std::setfill('0') << addr << std::dec
+                << std::endl;
+      return false;
+    }
+    for (uint32_t i = 0; i < length; ++i) {
+      out.put(ReadBus((uint16_t)(addr + i)));
+    }
+  } break;
+  }
+  out.flush();
+
+  pc = StackPop<DIAG_NONE>();
+  return true;
+}
+
+template <uint32_t Diag> void CPU::RunWith(uint32_t count) {
+  while (count > 0) {
+    // Still busy with the last instruction
+    if (pendingCycles >= count) {
+      pendingCycles -= count;
+      cycleCount += count;
+      return;
+    }
+    count -= pendingCycles + 1;
+    cycleCount += pendingCycles;
+
+    if constexpr ((Diag & DIAG_CPM) != 0) {
+      // Warm boot, the program is done
+      if (pc == 0x0000) {
+        cpmExited = true;
+        pendingCycles = 0;
+        return;
+      }
+      if (pc == 0x0005 && !BDOSCall()) {
+        cpmExited = true;
+        cpmFailed = true;
+        pendingCycles = 0;
+        return;
+      }
+    }
+
+    Step<Diag>();
   }
 }
 
 void CPU::Interrupt(uint8_t vector) {
-#ifdef PRINT_INTERRUPTS
-  std::cout << "DBG:    IRQ(0x" << std::hex << std::setw(2) << std::setfill('0')
-            << +vector << ")"
-            << "    PC: 0x" << std::setw(2) << +(vector * 8) << std::endl;
-#endif
+  // Ignored while disabled, like INT with INTE reset
+  if (!interrupts) {
+    return;
+  }
+
+  if (diagnostics & DIAG_LOG_INTERRUPTS) {
+    std::cout << "DBG:    IRQ(0x" << std::hex << std::setw(2)
+              << std::setfill('0') << +vector << ")"
+              << "    PC: 0x" << std::setw(2) << +(vector * 8) << std::endl;
+  }
 
   StackPush(pc);
   // No vector guards (yet)
   pc = vector * 8;
+
+  if (profiler != nullptr && (diagnostics & DIAG_PROFILE)) {
+    profiler->Interrupt(pc, sp);
+  }
   interrupts = false;
 }
 } // namespace invaders
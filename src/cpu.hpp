@@ -1,7 +1,13 @@
+#include <array>
 #include <functional>
+#include <ostream>
 #include <stdint.h>
+#include <utility>
 
 #include "config.h"
+#include "diagnostics.hpp"
+#include "profiler.hpp"
+#include "tracer.hpp"
 
 // Returns the register pair (a, b)
 #define GET_RP(a, b) (((uint16_t)a << 8) | (uint16_t)b)
@@ -29,6 +35,16 @@ typedef std::function<uint8_t(uint8_t)> ReadIOFunction;
 typedef std::function<void(uint8_t, uint8_t)> WriteIOFunction;
 
 #pragma once
+// Interpreter variants. They must behave identically, which the lockstep
+// checker (lockstep.hpp) verifies
+enum Engine {
+  // Every memory read goes through the bus callbacks
+  ENGINE_REFERENCE,
+  // Memory reads index the bus page table directly. Falls back to the
+  // reference engine while the bus has no page table to offer
+  ENGINE_FAST,
+};
+
 class CPU {
   // Stack pointer
   uint16_t sp;
@@ -89,10 +105,13 @@ class CPU {
 
   inline void UnimplementedOpcode(uint8_t opcode);
 
+  // Memory read for the engine selected by Diag
+  template <uint32_t Diag> inline uint8_t Read(uint16_t addr);
+
   // It returns the first operand by decoding the opcode (opcode >> 3) & 0x7)
-  inline uint8_t GetOperand8_0(uint8_t opcode);
+  template <uint32_t Diag> inline uint8_t GetOperand8_0(uint8_t opcode);
   // It returns the second operand by decoding the opcode (opcode & 0x07)
-  inline uint8_t GetOperand8_1(uint8_t opcode);
+  template <uint32_t Diag> inline uint8_t GetOperand8_1(uint8_t opcode);
   // It sets the first operand by decoding the opcode (opcode >> 3) & 0x7)
   inline void SetOperand8_0(uint8_t opcode, uint8_t value);
   // It returns the 16-bit operand (register pair) from the opcode
@@ -118,7 +137,7 @@ class CPU {
 
   // TODO: confirm stack ops
   inline void StackPush(uint16_t data);
-  inline uint16_t StackPop();
+  template <uint32_t Diag> inline uint16_t StackPop();
 
   uint8_t cycles[256] = {
       4,  10, 7,  5,  5,  5,  7,  4,  4,  10, 7,  5,  5,  5,  7,  4,  4,  10,
@@ -139,12 +158,68 @@ class CPU {
   };
 
   uint8_t pendingCycles = 0;
+  // Cycles elapsed and instructions executed since reset
+  uint64_t cycleCount = 0;
+  uint64_t instructionCount = 0;
+
+  Tracer *tracer = nullptr;
+  Profiler *profiler = nullptr;
+  uint32_t diagnostics = DIAG_NONE;
+
+  Engine engine = ENGINE_REFERENCE;
+  // Bus page table for ENGINE_FAST, 1 << pageBits bytes per page
+  const uint8_t *const *memoryPages = nullptr;
+  int pageBits = 0;
+  uint16_t pageMask = 0;
+  // Selects the fast engine in the Diag template argument, above the
+  // diagnostics bits
+  static constexpr uint32_t kFastEngine = 1 << kCPUDiagnosticBits;
+
+  // CP/M console output, whether the program jumped back to 0x0000 and
+  // whether it was stopped by a bad BDOS call
+  std::ostream *console = nullptr;
+  bool cpmExited = false;
+  bool cpmFailed = false;
+  // Handles a BDOS call (CALL 0x0005) and returns to the caller. Returns
+  // false when the call cannot complete
+  bool BDOSCall();
+
+  template <uint32_t Diag> void ExecuteOpcode(uint8_t opcode);
+  // Fetches and executes the next instruction
+  template <uint32_t Diag> inline void Step();
+  template <uint32_t Diag> void RunWith(uint32_t count);
+
+  // Instantiation of RunWith matching the enabled diagnostics
+  typedef void (CPU::*RunFunction)(uint32_t);
+  RunFunction runFunction;
+  void SelectRunFunction();
 
-  void ExecuteOpcode(uint8_t opcode);
+  // Table of every RunWith instantiation, indexed by the CPU diagnostics bits
+  template <uint32_t... Diag>
+  static constexpr std::array<RunFunction, sizeof...(Diag)>
+      MakeRunTable(std::integer_sequence<uint32_t, Diag...>) {
+    return {&CPU::RunWith<Diag>...};
+  }
 
 public:
   CPU(ReadBusFunction, WriteBusFunction, ReadIOFunction, WriteIOFunction);
 
+  // Snapshot of the complete CPU state
+  struct Registers {
+    uint16_t pc;
+    uint16_t sp;
+    uint8_t a;
+    uint8_t b;
+    uint8_t c;
+    uint8_t d;
+    uint8_t e;
+    uint8_t h;
+    uint8_t l;
+    uint8_t flags;
+    uint8_t pendingCycles;
+    bool interrupts;
+  };
+
   // Program counter
   uint16_t pc;
 
@@ -156,6 +231,47 @@ public:
 
   void Reset();
   void Tick();
+  // Same as calling Tick() `count` times, without the per-cycle overhead
+  void Run(uint32_t count) { (this->*runFunction)(count); }
+  // Runs RST `vector` unless interrupts are disabled
   void Interrupt(uint8_t vector);
+
+  Registers GetRegisters() const;
+  void SetRegisters(const Registers &regs);
+
+  uint64_t Cycles() const { return cycleCount; }
+  // Moves the cycle counter, for restoring states
+  void SetCycles(uint64_t cycles) { cycleCount = cycles; }
+  uint64_t Instructions() const { return instructionCount; }
+
+  // With DIAG_CPM, BDOS console output goes to `out` (stdout when nullptr)
+  void SetConsole(std::ostream *out) { console = out; }
+  // With DIAG_CPM, set once the program warm boots by jumping to 0x0000. The
+  // CPU then stops executing
+  bool CPMExited() const { return cpmExited; }
+  // With DIAG_CPM, set along with CPMExited() when a BDOS call could not
+  // complete, e.g. a C_WRITESTR string without its '$'
+  bool CPMFailed() const { return cpmFailed; }
+
+  void SetEngine(Engine engine);
+  Engine GetEngine() const { return engine; }
+  // Page table used by ENGINE_FAST for reads. The bus must keep it up to
+  // date. Pass nullptr when reads have to go through the callbacks
+  void SetMemoryPages(const uint8_t *const *pages, int pageBits);
+
+  // Replaces the bus callbacks
+  void SetBusFunctions(ReadBusFunction, WriteBusFunction, ReadIOFunction,
+                       WriteIOFunction);
+
+  // Enables a set of Diagnostics values. DIAG_TRACE_CPU only takes effect
+  // while a tracer is attached
+  void SetDiagnostics(uint32_t diagnostics);
+  uint32_t GetDiagnostics() const { return diagnostics; }
+  // Records executed instructions into `tracer` when DIAG_TRACE_CPU is
+  // enabled. Pass nullptr to detach
+  void SetTracer(Tracer *tracer);
+  // Profiles execution into `profiler` when DIAG_PROFILE is enabled. Pass
+  // nullptr to detach
+  void SetProfiler(Profiler *profiler);
 };
 } // namespace invaders
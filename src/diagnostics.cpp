@@ -0,0 +1,18 @@
+#include <cstring>
+#include <stdint.h>
+
+#include "diagnostics.hpp"
+
+namespace invaders {
+bool ParseDiagnosticsFlag(const char *arg, uint32_t &diagnostics) {
+  if (strcmp(arg, "--log-interrupts") == 0) {
+    diagnostics |= DIAG_LOG_INTERRUPTS;
+  } else if (strcmp(arg, "--log-mem-writes") == 0) {
+    diagnostics |= DIAG_LOG_MEM_WRITES;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+} // namespace invaders
@@ -0,0 +1,39 @@
+#include <stdint.h>
+
+namespace invaders {
+#pragma once
+// Runtime switchable diagnostics. Each combination is a separate template
+// instantiation of the CPU loop or bus callbacks, selected once when the
+// diagnostics change, so disabled diagnostics cost nothing per instruction
+enum Diagnostics : uint32_t {
+  DIAG_NONE = 0,
+
+  // Diagnostics handled inside the CPU instruction loop. They must occupy the
+  // lowest kCPUDiagnosticBits bits
+
+  // Records every executed instruction into the attached Tracer
+  DIAG_TRACE_CPU = 1 << 0,
+  // Traps CP/M BDOS console calls at 0x0005 and stops on a jump to 0x0000,
+  // for running CPU exerciser programs (see tools/cpm.cpp)
+  DIAG_CPM = 1 << 1,
+  // Counts executions and cycles per PC and builds the call tree into the
+  // attached Profiler
+  DIAG_PROFILE = 1 << 2,
+
+  // Diagnostics handled by the bus
+
+  // Prints memory writes to stdout
+  DIAG_LOG_MEM_WRITES = 1 << 8,
+  // Prints external interrupts to stdout
+  DIAG_LOG_INTERRUPTS = 1 << 9,
+  // Counts accesses per address and IO port into the attached MemoryStats
+  DIAG_MEM_STATS = 1 << 10,
+};
+
+constexpr int kCPUDiagnosticBits = 3;
+constexpr uint32_t kCPUDiagnosticsMask = (1 << kCPUDiagnosticBits) - 1;
+
+// Parses a command line flag (--log-interrupts or --log-mem-writes)
+// into `diagnostics`. Returns false if `arg` is not a diagnostics flag
+bool ParseDiagnosticsFlag(const char *arg, uint32_t &diagnostics);
+} // namespace invaders
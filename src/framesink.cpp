@@ -0,0 +1,122 @@
+#include <chrono>
+#include <iostream>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+
+#include "framesink.hpp"
+#include "video.hpp"
+
+namespace invaders {
+static const size_t kRGBSize = kScreenWidth * kScreenHeight * 3;
+static const size_t kPlaneSize = kScreenWidth * kScreenHeight;
+
+bool ParseFrameFormat(const std::string name, FrameFormat &format) {
+  if (name == "y4m") {
+    format = FRAME_Y4M;
+  } else if (name == "1bpp") {
+    format = FRAME_1BPP;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+FrameSink::FrameSink(size_t capacity) : frames(capacity) {}
+
+FrameSink::~FrameSink() { Close(); }
+
+bool FrameSink::Open(const std::string path, FrameFormat format) {
+  Close();
+
+  file = path == "-" ? stdout : fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "Unable to open video file \"" << path << "\"" << std::endl;
+    return false;
+  }
+
+  this->format = format;
+  writtenFrames = 0;
+  droppedFrames = 0;
+
+  if (format == FRAME_Y4M) {
+    fprintf(file, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C444\n", kScreenWidth,
+            kScreenHeight);
+    rgb.resize(kRGBSize);
+    output.resize(kPlaneSize * 3);
+  } else {
+    output.resize(kPackedFrameSize);
+  }
+
+  running = true;
+  writer = std::thread(&FrameSink::WriterLoop, this);
+  return true;
+}
+
+void FrameSink::Close() {
+  if (file == nullptr) {
+    return;
+  }
+
+  running = false;
+  writer.join();
+
+  if (file == stdout) {
+    fflush(file);
+  } else {
+    fclose(file);
+  }
+  file = nullptr;
+}
+
+bool FrameSink::Submit(const uint8_t *vram, bool wait) {
+  Frame frame;
+  memcpy(frame.vram, vram, kVRAMSize);
+
+  while (!frames.TryPush(frame)) {
+    if (!wait) {
+      droppedFrames.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+
+  return true;
+}
+
+void FrameSink::WriterLoop() {
+  DrainUntilStopped(frames, running, 1,
+                    [this](const Frame *batch, size_t count) {
+                      for (size_t i = 0; i < count; ++i) {
+                        WriteFrame(batch[i]);
+                      }
+                    });
+}
+
+void FrameSink::WriteFrame(const Frame &frame) {
+  if (format == FRAME_Y4M) {
+    VRAMToRGB(frame.vram, rgb.data(), overlay);
+
+    // BT.601 limited range
+    auto *y = output.data();
+    auto *u = y + kPlaneSize;
+    auto *v = u + kPlaneSize;
+    for (size_t i = 0; i < kPlaneSize; ++i) {
+      int r = rgb[i * 3], g = rgb[i * 3 + 1], b = rgb[i * 3 + 2];
+      y[i] = (uint8_t)(16 + ((66 * r + 129 * g + 25 * b + 128) >> 8));
+      u[i] = (uint8_t)(128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8));
+      v[i] = (uint8_t)(128 + ((112 * r - 94 * g - 18 * b + 128) >> 8));
+    }
+
+    fputs("FRAME\n", file);
+  } else {
+    VRAMToPacked(frame.vram, output.data());
+  }
+
+  fwrite(output.data(), 1, output.size(), file);
+  ++writtenFrames;
+}
+} // namespace invaders
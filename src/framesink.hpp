@@ -0,0 +1,75 @@
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "observation.hpp"
+#include "spsc.hpp"
+#include "video.hpp"
+
+namespace invaders {
+#pragma once
+enum FrameFormat {
+  // YUV4MPEG2 stream, 4:4:4 with the color overlay, 60 fps
+  FRAME_Y4M,
+  // Headerless packed 1bpp frames, see VRAMToPacked()
+  FRAME_1BPP,
+};
+
+// Parses "y4m" or "1bpp"
+bool ParseFrameFormat(const std::string name, FrameFormat &format);
+
+// Streams emulated frames to a file or to stdout, e.g. for piping into
+// ffmpeg. Frames are queued as raw VRAM into a bounded ring and converted and
+// written by a writer thread, so slow I/O drops frames instead of stalling
+// the emulation
+class FrameSink {
+  struct Frame {
+    uint8_t vram[kVRAMSize];
+  };
+
+  SpscRing<Frame> frames;
+  std::atomic<uint64_t> droppedFrames{0};
+  uint64_t writtenFrames = 0;
+
+  FILE *file = nullptr;
+  FrameFormat format = FRAME_Y4M;
+  Overlay overlay = DefaultOverlay();
+  std::thread writer;
+  std::atomic<bool> running{false};
+
+  // Writer thread state
+  std::vector<uint8_t> rgb;
+  std::vector<uint8_t> output;
+
+  void WriterLoop();
+  void WriteFrame(const Frame &frame);
+
+public:
+  explicit FrameSink(size_t capacity = 64);
+  ~FrameSink();
+
+  FrameSink(const FrameSink &) = delete;
+  FrameSink &operator=(const FrameSink &) = delete;
+
+  // "-" writes to stdout
+  bool Open(const std::string path, FrameFormat format);
+  // Colors of the Y4M frames. Only call while closed
+  void SetOverlay(const Overlay &overlay) { this->overlay = overlay; }
+  // Writes every queued frame and closes the output
+  void Close();
+
+  // Queues a copy of kVRAMSize bytes of VRAM. Returns false if the frame was
+  // dropped, or with `wait` waits for room instead, for offline runs which
+  // must not lose frames
+  bool Submit(const uint8_t *vram, bool wait = false);
+
+  bool IsOpen() const { return file != nullptr; }
+  uint64_t DroppedFrames() const { return droppedFrames.load(); }
+  // Only exact once closed
+  uint64_t WrittenFrames() const { return writtenFrames; }
+};
+} // namespace invaders
@@ -0,0 +1,25 @@
+#include <stdint.h>
+
+namespace invaders {
+#pragma once
+// SplitMix64 finalizer. Cheap, well distributed and good enough for detecting
+// state divergence (this is not a cryptographic hash)
+inline uint64_t HashMix(uint64_t x) {
+  x += 0x9e3779b97f4a7c15;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+  return x ^ (x >> 31);
+}
+
+// Order dependent combination of two hashes
+inline uint64_t HashCombine(uint64_t seed, uint64_t value) {
+  return HashMix(seed ^ (value + (seed << 6) + (seed >> 2)));
+}
+
+// Hash contribution of a single memory cell. The memory hash is the sum of
+// these over the whole address space, so a write can update it in O(1) by
+// subtracting the old cell and adding the new one
+inline uint64_t HashMemCell(uint16_t addr, uint8_t data) {
+  return HashMix(((uint64_t)addr << 8) | data);
+}
+} // namespace invaders
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "bus.hpp"
+#include "invaders.h"
+
+static_assert(INVADERS_INPUT_COIN == invaders::COIN, "Input bits mismatch");
+static_assert(INVADERS_INPUT_P2_START == invaders::P2_START,
+              "Input bits mismatch");
+static_assert(INVADERS_INPUT_P1_START == invaders::P1_START,
+              "Input bits mismatch");
+static_assert(INVADERS_INPUT_P1_FIRE == invaders::P1_FIRE,
+              "Input bits mismatch");
+static_assert(INVADERS_INPUT_P1_LEFT == invaders::P1_LEFT,
+              "Input bits mismatch");
+static_assert(INVADERS_INPUT_P1_RIGHT == invaders::P1_RIGHT,
+              "Input bits mismatch");
+static_assert(INVADERS_INPUT_TILT == invaders::TILT, "Input bits mismatch");
+static_assert(INVADERS_INPUT_P2_FIRE == invaders::P2_FIRE,
+              "Input bits mismatch");
+static_assert(INVADERS_INPUT_P2_LEFT == invaders::P2_LEFT,
+              "Input bits mismatch");
+static_assert(INVADERS_INPUT_P2_RIGHT == invaders::P2_RIGHT,
+              "Input bits mismatch");
+static_assert(INVADERS_DIP_LIVES == invaders::DIP_LIVES, "DIP bits mismatch");
+static_assert(INVADERS_DIP_BONUS_1000 == invaders::DIP_BONUS_1000,
+              "DIP bits mismatch");
+static_assert(INVADERS_DIP_COIN_INFO_OFF == invaders::DIP_COIN_INFO_OFF,
+              "DIP bits mismatch");
+static_assert(INVADERS_FRAMEBUFFER_SIZE == invaders::kVRAMSize,
+              "Framebuffer size mismatch");
+
+struct invaders_machine {
+  invaders::Bus bus;
+};
+
+// Exceptions must not cross the C boundary, and the core throws
+// std::bad_alloc when it runs out of memory (e.g. copying a shared page).
+// Returns `body()`, or -1 if it throws
+template <typename Body> static int Guarded(Body body) {
+  try {
+    return body();
+  } catch (...) {
+    return -1;
+  }
+}
+
+uint32_t invaders_api_version(void) { return INVADERS_API_VERSION; }
+
+invaders_machine *invaders_create(void) {
+  try {
+    auto *machine = new invaders_machine();
+    machine->bus.Reset();
+    return machine;
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+void invaders_destroy(invaders_machine *machine) { delete machine; }
+
+int invaders_load_rom(invaders_machine *machine, const uint8_t *data,
+                      size_t size, uint16_t address) {
+  return Guarded([&]() {
+    return machine->bus.LoadAt(data, size, address) ? 0 : -1;
+  });
+}
+
+int invaders_load_rom_file(invaders_machine *machine, const char *path) {
+  return Guarded([&]() {
+    return path != nullptr && machine->bus.LoadROM(path) ? 0 : -1;
+  });
+}
+
+void invaders_reset(invaders_machine *machine) { machine->bus.Reset(); }
+
+int invaders_run_frames(invaders_machine *machine, uint32_t frames) {
+  return Guarded([&]() {
+    for (uint32_t i = 0; i < frames; ++i) {
+      machine->bus.RunFrame();
+    }
+    return 0;
+  });
+}
+
+void invaders_set_inputs(invaders_machine *machine, uint32_t inputs) {
+  machine->bus.SetInputs(inputs);
+}
+
+void invaders_set_dip_switches(invaders_machine *machine, uint32_t dips) {
+  machine->bus.SetDipSwitches(dips);
+}
+
+size_t invaders_read_framebuffer(const invaders_machine *machine, uint8_t *dst,
+                                 size_t size) {
+  size = std::min(size, (size_t)invaders::kVRAMSize);
+  memcpy(dst, machine->bus.DisplayFrame(), size);
+  return size;
+}
+
+size_t invaders_read_memory(const invaders_machine *machine, uint16_t address,
+                            uint8_t *dst, size_t size) {
+  size = std::min(size, (size_t)(1 << 16) - address);
+  machine->bus.CopyMem(address, dst, size);
+  return size;
+}
+
+size_t invaders_state_size(void) { return invaders::Bus::kStateSize; }
+
+int invaders_save_state(const invaders_machine *machine, uint8_t *dst,
+                        size_t size) {
+  if (size < invaders::Bus::kStateSize) {
+    return -1;
+  }
+  return Guarded([&]() {
+    machine->bus.SaveState(dst);
+    return 0;
+  });
+}
+
+int invaders_load_state(invaders_machine *machine, const uint8_t *src,
+                        size_t size) {
+  return Guarded(
+      [&]() { return machine->bus.LoadState(src, size) ? 0 : -1; });
+}
+
+uint64_t invaders_frame_hash(const invaders_machine *machine) {
+  return machine->bus.FrameHash();
+}
+
+uint64_t invaders_frame_count(const invaders_machine *machine) {
+  return machine->bus.FrameCount();
+}
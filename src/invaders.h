@@ -0,0 +1,115 @@
+#ifndef _INVADERS_H
+#define _INVADERS_H
+/*
+ * Stable C API for embedding the emulator core.
+ *
+ * All functions are plain C with caller owned buffers, so they can be called
+ * directly through FFIs like Python's ctypes:
+ *
+ *   lib = ctypes.CDLL("libinvaders-c.so")
+ *   lib.invaders_create.restype = ctypes.c_void_p
+ *   m = lib.invaders_create()
+ *
+ * Functions returning int return 0 on success and a negative value on error,
+ * including running out of memory.
+ * A machine must only be used by one thread at a time.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+/* INVADERS_BUILDING is only defined while building the library itself */
+#if defined(_WIN32) || defined(_WIN64)
+#ifdef INVADERS_BUILDING
+#define INVADERS_API __declspec(dllexport)
+#else
+#define INVADERS_API __declspec(dllimport)
+#endif
+#else
+#define INVADERS_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped on incompatible changes */
+#define INVADERS_API_VERSION 1
+
+/* Input bits for invaders_set_inputs */
+#define INVADERS_INPUT_COIN 0x01
+#define INVADERS_INPUT_P2_START 0x02
+#define INVADERS_INPUT_P1_START 0x04
+#define INVADERS_INPUT_P1_FIRE 0x10
+#define INVADERS_INPUT_P1_LEFT 0x20
+#define INVADERS_INPUT_P1_RIGHT 0x40
+#define INVADERS_INPUT_TILT 0x0400
+#define INVADERS_INPUT_P2_FIRE 0x1000
+#define INVADERS_INPUT_P2_LEFT 0x2000
+#define INVADERS_INPUT_P2_RIGHT 0x4000
+
+/* DIP switch bits for invaders_set_dip_switches */
+#define INVADERS_DIP_LIVES 0x03 /* Ships per game minus 3 */
+#define INVADERS_DIP_BONUS_1000 0x08 /* Extra ship at 1000 points, not 1500 */
+#define INVADERS_DIP_COIN_INFO_OFF 0x80
+
+/* Size of the 1bpp framebuffer returned by invaders_read_framebuffer */
+#define INVADERS_FRAMEBUFFER_SIZE (224 * 32)
+
+typedef struct invaders_machine invaders_machine;
+
+INVADERS_API uint32_t invaders_api_version(void);
+
+/* Returns NULL on allocation failure */
+INVADERS_API invaders_machine *invaders_create(void);
+INVADERS_API void invaders_destroy(invaders_machine *machine);
+
+/* Copies `size` bytes of ROM (or any data) to `address` */
+INVADERS_API int invaders_load_rom(invaders_machine *machine,
+                                   const uint8_t *data, size_t size,
+                                   uint16_t address);
+/*
+ * Loads a ROM image file, or a directory holding the invaders.h/g/f/e split
+ * set, at 0x0000. Images are verified and cached, so loading the same ROM
+ * into many machines reads it once and shares its memory
+ */
+INVADERS_API int invaders_load_rom_file(invaders_machine *machine,
+                                        const char *path);
+INVADERS_API void invaders_reset(invaders_machine *machine);
+
+INVADERS_API int invaders_run_frames(invaders_machine *machine,
+                                     uint32_t frames);
+/* Bitmask of INVADERS_INPUT_* values */
+INVADERS_API void invaders_set_inputs(invaders_machine *machine,
+                                      uint32_t inputs);
+/* Bitmask of INVADERS_DIP_* values, kept across resets */
+INVADERS_API void invaders_set_dip_switches(invaders_machine *machine,
+                                            uint32_t dips);
+
+/*
+ * Copies the last displayed frame of video RAM (224 columns of 32 bytes, 1
+ * bit per pixel, bottom pixel in bit 0) into `dst`. Returns the number of
+ * bytes written
+ */
+INVADERS_API size_t invaders_read_framebuffer(const invaders_machine *machine,
+                                              uint8_t *dst, size_t size);
+/* Copies `size` bytes of memory starting at `address`. Returns the number of
+ * bytes written */
+INVADERS_API size_t invaders_read_memory(const invaders_machine *machine,
+                                         uint16_t address, uint8_t *dst,
+                                         size_t size);
+
+INVADERS_API size_t invaders_state_size(void);
+INVADERS_API int invaders_save_state(const invaders_machine *machine,
+                                     uint8_t *dst, size_t size);
+INVADERS_API int invaders_load_state(invaders_machine *machine,
+                                     const uint8_t *src, size_t size);
+
+/* State hash sampled at the last vblank and the number of frames run */
+INVADERS_API uint64_t invaders_frame_hash(const invaders_machine *machine);
+INVADERS_API uint64_t invaders_frame_count(const invaders_machine *machine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <stdint.h>
+
+#include "bus.hpp"
+#include "cpu.hpp"
+#include "lockstep.hpp"
+
+namespace invaders {
+static bool SameRegisters(const CPU::Registers &a, const CPU::Registers &b) {
+  return a.pc == b.pc && a.sp == b.sp && a.a == b.a && a.b == b.b &&
+         a.c == b.c && a.d == b.d && a.e == b.e && a.h == b.h && a.l == b.l &&
+         a.flags == b.flags && a.pendingCycles == b.pendingCycles &&
+         a.interrupts == b.interrupts;
+}
+
+Lockstep::Lockstep(Bus &reference, Bus &candidate)
+    : reference(reference), candidate(candidate) {}
+
+void Lockstep::Record() {
+  auto instructions = reference.cpu.Instructions();
+
+  // Only keep one entry per executed instruction
+  if (historyCount > 0 &&
+      history[(historyCount - 1) % kHistorySize].instructions ==
+          instructions) {
+    return;
+  }
+
+  auto regs = reference.cpu.GetRegisters();
+  history[historyCount % kHistorySize] = {instructions, regs,
+                                          reference.Peek(regs.pc)};
+  ++historyCount;
+}
+
+bool Lockstep::Matches() const {
+  return SameRegisters(reference.cpu.GetRegisters(),
+                       candidate.cpu.GetRegisters()) &&
+         reference.cpu.Cycles() == candidate.cpu.Cycles() &&
+         reference.cpu.Instructions() == candidate.cpu.Instructions() &&
+         reference.FrameCycle() == candidate.FrameCycle() &&
+         reference.StateHash() == candidate.StateHash();
+}
+
+bool Lockstep::Run(uint64_t cycles, uint32_t interval, std::ostream &out) {
+  interval = std::max<uint32_t>(interval, 1);
+
+  while (cycles > 0) {
+    auto chunk = (uint32_t)std::min<uint64_t>(cycles, interval);
+    reference.Run(chunk);
+    candidate.Run(chunk);
+    cycles -= chunk;
+
+    ++comparisons;
+    if (!Matches()) {
+      Dump(out);
+      return false;
+    }
+    Record();
+  }
+
+  return true;
+}
+
+void Lockstep::Dump(std::ostream &out) const {
+  auto ref = reference.cpu.GetRegisters();
+  auto cand = candidate.cpu.GetRegisters();
+
+  out << std::dec << "Divergence after " << reference.cpu.Cycles()
+      << " cycles, frame " << reference.FrameCount() << " + "
+      << reference.FrameCycle() << " cycles" << std::endl;
+
+  auto row = [&out](const char *name, uint64_t a, uint64_t b, int width) {
+    out << std::left << std::setw(14) << name << std::right << std::hex
+        << std::setfill('0') << std::setw(width) << a << "  " << std::setw(width)
+        << b << std::setfill(' ') << (a != b ? "  *" : "") << std::dec
+        << std::endl;
+  };
+
+  out << "              reference  candidate" << std::endl;
+  row("pc", ref.pc, cand.pc, 4);
+  row("sp", ref.sp, cand.sp, 4);
+  row("a", ref.a, cand.a, 2);
+  row("b", ref.b, cand.b, 2);
+  row("c", ref.c, cand.c, 2);
+  row("d", ref.d, cand.d, 2);
+  row("e", ref.e, cand.e, 2);
+  row("h", ref.h, cand.h, 2);
+  row("l", ref.l, cand.l, 2);
+  row("flags", ref.flags, cand.flags, 2);
+  row("pending", ref.pendingCycles, cand.pendingCycles, 2);
+  row("interrupts", ref.interrupts, cand.interrupts, 1);
+  row("cycles", reference.cpu.Cycles(), candidate.cpu.Cycles(), 12);
+  row("instructions", reference.cpu.Instructions(),
+      candidate.cpu.Instructions(), 12);
+  row("frame cycle", reference.FrameCycle(), candidate.FrameCycle(), 8);
+  row("state hash", reference.StateHash(), candidate.StateHash(), 16);
+
+  int differences = 0;
+  for (uint32_t addr = 0; addr < (1 << 16); ++addr) {
+    auto a = reference.Peek(addr);
+    auto b = candidate.Peek(addr);
+    if (a == b) {
+      continue;
+    }
+
+    if (differences < 16) {
+      out << "mem[" << std::hex << std::setfill('0') << std::setw(4) << addr
+          << "]     " << std::setw(2) << +a << "    " << std::setw(2) << +b
+          << std::setfill(' ') << std::dec << std::endl;
+    }
+    ++differences;
+  }
+  out << differences << " differing memory bytes" << std::endl;
+
+  out << "Reference after the last instructions (oldest first, pc and op of "
+         "the next one):"
+      << std::endl;
+  auto count = std::min(historyCount, kHistorySize);
+  for (size_t i = historyCount - count; i < historyCount; ++i) {
+    auto &entry = history[i % kHistorySize];
+    auto &r = entry.regs;
+    out << std::dec << std::setw(12) << entry.instructions << std::hex
+        << std::setfill('0') << "  pc " << std::setw(4) << r.pc << "  op "
+        << std::setw(2) << +entry.opcode << "  a " << std::setw(2) << +r.a
+        << " bc " << std::setw(2) << +r.b << std::setw(2) << +r.c << " de "
+        << std::setw(2) << +r.d << std::setw(2) << +r.e << " hl "
+        << std::setw(2) << +r.h << std::setw(2) << +r.l << " sp "
+        << std::setw(4) << r.sp << " f " << std::setw(2) << +r.flags
+        << std::setfill(' ') << std::dec << std::endl;
+  }
+}
+} // namespace invaders
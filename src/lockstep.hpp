@@ -0,0 +1,50 @@
+#include <ostream>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bus.hpp"
+#include "cpu.hpp"
+
+namespace invaders {
+#pragma once
+// Runs two machines side by side, typically on different CPU engines, and
+// stops at the first point where their states differ. Both must start from
+// the same state and receive the same inputs
+class Lockstep {
+  Bus &reference;
+  Bus &candidate;
+
+  // Reference registers after the last compared instructions, for the
+  // context dump
+  static constexpr size_t kHistorySize = 32;
+  struct HistoryEntry {
+    uint64_t instructions;
+    CPU::Registers regs;
+    // Opcode at regs.pc, the next instruction
+    uint8_t opcode;
+  };
+  HistoryEntry history[kHistorySize];
+  size_t historyCount = 0;
+
+  uint64_t comparisons = 0;
+
+  void Record();
+
+public:
+  Lockstep(Bus &reference, Bus &candidate);
+
+  // Runs both machines for `cycles`, comparing them every `interval` cycles.
+  // An interval of 1 compares after every instruction. Returns false at the
+  // first divergence, after writing a context dump to `out`
+  bool Run(uint64_t cycles, uint32_t interval, std::ostream &out);
+
+  // Compares registers, cycle and instruction counters, the frame position
+  // and the state hash (memory and IO latches)
+  bool Matches() const;
+  // Writes both register sets, the differing memory and the last
+  // instructions of the reference
+  void Dump(std::ostream &out) const;
+
+  uint64_t Comparisons() const { return comparisons; }
+};
+} // namespace invaders
@@ -1,7 +1,13 @@
 #include <SDL_events.h>
 #include <SDL_keycode.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <stdint.h>
+#include <string>
+#include <vector>
 
 // Dear Imgui
 #include <imgui.h>
@@ -18,8 +24,20 @@
 
 #include "config.h"
 
+#include "audio.hpp"
+#include "capture.hpp"
 #include "bus.hpp"
+#include "diagnostics.hpp"
 #include "font.h"
+#include "memstats.hpp"
+#include "metrics.hpp"
+#include "options.hpp"
+#include "perfcounters.hpp"
+#include "profiler.hpp"
+#include "rom.hpp"
+#include "tracer.hpp"
+#include "upscale.hpp"
+#include "video.hpp"
 
 #if defined(_WIN32) || defined(_WIN64)
 #pragma comment(lib, "shcore")
@@ -31,8 +49,61 @@ void initializePlatform() {
 void initializePlatform() {}
 #endif
 
+// SDL audio callback, pulls mixed samples from the audio engine
+void audioCallback(void *userdata, Uint8 *stream, int len) {
+  auto audio = static_cast<invaders::Audio *>(userdata);
+  audio->Read(reinterpret_cast<int16_t *>(stream), len / sizeof(int16_t));
+}
+
 int main(int argc, char **args) {
-  if (argc < 1) {
+  const char *romPath = nullptr;
+  std::string tracePath = "invaders.trace";
+  std::string profilePath = "invaders.folded";
+  const char *metricsPath = nullptr;
+  double metricsInterval = 10;
+  bool perf = false;
+  const char *recordPath = nullptr;
+  std::string captureDir = ".";
+  int captureThreads = 0;
+  auto overlay = invaders::DefaultOverlay();
+  uint32_t diagnostics = invaders::DIAG_NONE;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(args[i], "--trace") == 0 && i + 1 < argc) {
+      tracePath = args[++i];
+      diagnostics |= invaders::DIAG_TRACE_CPU;
+    } else if (strcmp(args[i], "--profile") == 0 && i + 1 < argc) {
+      profilePath = args[++i];
+      diagnostics |= invaders::DIAG_PROFILE;
+    } else if (strcmp(args[i], "--metrics-dump") == 0 && i + 1 < argc) {
+      metricsPath = args[++i];
+    } else if (strcmp(args[i], "--metrics-interval") == 0 && i + 1 < argc) {
+      metricsInterval = std::stod(args[++i]);
+    } else if (strcmp(args[i], "--perf") == 0) {
+      perf = true;
+    } else if (strcmp(args[i], "--record-inputs") == 0 && i + 1 < argc) {
+      recordPath = args[++i];
+    } else if (strcmp(args[i], "--capture-dir") == 0 && i + 1 < argc) {
+      captureDir = args[++i];
+    } else if (strcmp(args[i], "--capture-threads") == 0 && i + 1 < argc) {
+      // 0 for one per core
+      uint64_t threads;
+      if (!invaders::ParseNumberOption(args[i], args[i + 1], 10, 0, 1024,
+                                       threads)) {
+        return 1;
+      }
+      captureThreads = threads;
+      ++i;
+    } else if (strcmp(args[i], "--overlay") == 0 && i + 1 < argc) {
+      if (!invaders::LoadOverlay(args[++i], overlay)) {
+        return 1;
+      }
+    } else if (!invaders::ParseDiagnosticsFlag(args[i], diagnostics)) {
+      romPath = args[i];
+    }
+  }
+
+  if (romPath == nullptr) {
     std::cout << "No invaders ROM files specified. Aborting..." << std::endl;
     return 1;
   }
@@ -40,16 +111,86 @@ int main(int argc, char **args) {
   invaders::Bus bus;
   bus.Reset();
 
-  if (!bus.LoadFileAt(args[1], 0x0000)) {
+  auto rom = invaders::LoadROM(romPath);
+  if (rom == nullptr) {
     std::cerr << "Unable to start the emulator";
     return -1;
   }
+  bus.LoadROM(rom);
+
+  invaders::Metrics metrics;
+  std::ofstream metricsDump;
+  if (metricsPath != nullptr) {
+    metricsDump.open(metricsPath, std::ios::app);
+    if (metricsDump) {
+      metrics.SetDump(&metricsDump, metricsInterval);
+    } else {
+      std::cerr << "Unable to open \"" << metricsPath << "\"" << std::endl;
+    }
+  }
+  std::vector<float> metricsPlot;
+
+  // Hardware counters around the emulation section
+  invaders::PerfCounters perfCounters;
+  if (perf) {
+    perf = perfCounters.Open();
+  }
+
+  // Replayable with invaders-headless --replay-inputs
+  std::ofstream inputLog;
+  if (recordPath != nullptr) {
+    inputLog.open(recordPath);
+    if (inputLog) {
+      bus.SetInputLog(&inputLog);
+    } else {
+      std::cerr << "Unable to open \"" << recordPath << "\"" << std::endl;
+    }
+  }
 
-  if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER) != 0) {
+  invaders::Tracer tracer;
+  if ((diagnostics & invaders::DIAG_TRACE_CPU) && tracer.Start(tracePath)) {
+    bus.cpu.SetTracer(&tracer);
+  }
+
+  invaders::Profiler profiler;
+  bus.cpu.SetProfiler(&profiler);
+
+  auto memStats = std::make_unique<invaders::MemoryStats>();
+  bus.SetMemoryStats(memStats.get());
+
+  bus.SetDiagnostics(diagnostics);
+
+  if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_AUDIO) != 0) {
     std::cerr << "SDL Error: " << SDL_GetError() << std::endl;
     return -1;
   }
 
+  invaders::Audio audio;
+  bool muted = false;
+
+  // PNG screenshots (F12) and frame sequences (F11), written by workers
+  invaders::FrameCapture capture(captureThreads);
+  bool screenshot = false;
+  bool recording = false;
+
+  SDL_AudioSpec audioSpec = {};
+  audioSpec.freq = invaders::Audio::kSampleRate;
+  audioSpec.format = AUDIO_S16SYS;
+  audioSpec.channels = 1;
+  audioSpec.samples = 512;
+  audioSpec.callback = audioCallback;
+  audioSpec.userdata = &audio;
+
+  auto audioDevice = SDL_OpenAudioDevice(NULL, 0, &audioSpec, NULL, 0);
+  if (audioDevice == 0) {
+    std::cerr << "Unable to open the audio device: " << SDL_GetError()
+              << std::endl;
+  } else {
+    audio.Start(true);
+    bus.SetAudio(&audio);
+    SDL_PauseAudioDevice(audioDevice, 0);
+  }
+
   // Initialize platform specific stuff like DPI awareness
   initializePlatform();
 
@@ -126,10 +267,21 @@ int main(int argc, char **args) {
   auto lastPartialFrame = SDL_GetTicks();
   bool vblank = false;
 
-  const uint16_t vramStart = 0x2400;
   auto displayScale = 3;
 
-  GLubyte displayFramebuffer[224 * 256 * 3];
+  GLubyte
+      displayFramebuffer[invaders::kScreenWidth * invaders::kScreenHeight * 3];
+
+  // Optional CPU upscaling filter, 0 being none. The texture then holds the
+  // upscaled image, which screenshots and recordings also take
+  const char *filterNames[] = {"None", "Scale2x", "Scale3x", "xBR"};
+  int displayFilter = 0;
+  std::unique_ptr<invaders::Upscaler> upscaler;
+
+  // Phosphor afterglow, unscaled display only
+  bool phosphorEnabled = false;
+  float persistence = 0.5f;
+  invaders::Phosphor phosphor(persistence);
 
   GLuint displayTexture;
   glGenTextures(1, &displayTexture);
@@ -146,6 +298,14 @@ int main(int argc, char **args) {
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 224, 256, 0, GL_RGB, GL_UNSIGNED_BYTE,
                displayFramebuffer);
 
+  uint8_t heatmap[256 * 256 * 4];
+
+  GLuint heatmapTexture;
+  glGenTextures(1, &heatmapTexture);
+  glBindTexture(GL_TEXTURE_2D, heatmapTexture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
   while (!done) {
     SDL_Event event;
     while (SDL_PollEvent(&event)) {
@@ -155,15 +315,46 @@ int main(int argc, char **args) {
         done = true;
       }
 
+      if (event.type == SDL_KEYDOWN && !event.key.repeat) {
+        if (event.key.keysym.sym == SDLK_F12) {
+          screenshot = true;
+        } else if (event.key.keysym.sym == SDLK_F11) {
+          recording = !recording;
+        }
+      }
+
       if (event.type == SDL_KEYUP || event.type == SDL_KEYDOWN) {
         auto p = event.type == SDL_KEYDOWN;
 
+        // Keys land in the next frame at the same offset they had in the
+        // current one, a constant frame of latency instead of snapping them
+        // to frame boundaries
+        auto offset = event.key.timestamp > lastPartialFrame
+                          ? event.key.timestamp - lastPartialFrame
+                          : 0;
+        auto cycle = bus.cpu.Cycles() +
+                     std::min<uint64_t>(invaders::Bus::kFrameCycles - 1,
+                                        offset * invaders::Bus::kFrameCycles /
+                                            16);
+
+        auto state = invaders::COIN;
+        auto mapped = true;
         switch (event.key.keysym.sym) {
-        case SDLK_LEFT: bus.SetKeyboardState(invaders::P1_LEFT, p); break;
-        case SDLK_RIGHT: bus.SetKeyboardState(invaders::P1_RIGHT, p); break;
-        case SDLK_c: bus.SetKeyboardState(invaders::COIN, p); break;
-        case SDLK_SPACE: bus.SetKeyboardState(invaders::P1_FIRE, p); break;
-        case SDLK_1: bus.SetKeyboardState(invaders::P1_START, p); break;
+        case SDLK_c: state = invaders::COIN; break;
+        case SDLK_t: state = invaders::TILT; break;
+        case SDLK_1: state = invaders::P1_START; break;
+        case SDLK_LEFT: state = invaders::P1_LEFT; break;
+        case SDLK_RIGHT: state = invaders::P1_RIGHT; break;
+        case SDLK_SPACE: state = invaders::P1_FIRE; break;
+        case SDLK_2: state = invaders::P2_START; break;
+        case SDLK_a: state = invaders::P2_LEFT; break;
+        case SDLK_d: state = invaders::P2_RIGHT; break;
+        case SDLK_w: state = invaders::P2_FIRE; break;
+        default: mapped = false; break;
+        }
+
+        if (mapped) {
+          bus.QueueKeyboardState(cycle, state, p);
         }
       }
 
@@ -174,6 +365,9 @@ int main(int argc, char **args) {
       }
     }
 
+    int emulatedFrames = 0;
+    int droppedFrames = 0;
+
     if (!paused) {
       // Timers
       auto now = SDL_GetTicks();
@@ -183,54 +377,58 @@ int main(int argc, char **args) {
       auto delta = now - lastPartialFrame;
 
       if (delta >= 16) {
-        for (int i = 0; i < 16'500; i++) {
-          bus.TickCPU();
-        }
-        bus.cpu.Interrupt(1);
-        for (int i = 0; i < 16'500; i++) {
-          bus.TickCPU();
+        metrics.Begin(invaders::Metrics::SECTION_EMULATION);
+        if (perf) {
+          perfCounters.Start();
+          bus.RunFrame();
+          perfCounters.Stop();
+        } else {
+          bus.RunFrame();
         }
-        bus.cpu.Interrupt(2);
+        metrics.End(invaders::Metrics::SECTION_EMULATION);
+
+        // Only one frame is emulated per tick, anything beyond that is lost
+        emulatedFrames = 1;
+        droppedFrames = delta / 16 - 1;
         lastPartialFrame = now;
       }
 
-      for (unsigned int x = 0; x < 224; ++x) {
-        for (unsigned int y = 0; y < 32; ++y) {
-          auto byte = bus.mem[vramStart + ((x * 32) + y)];
-          for (unsigned int bit = 0; bit < 8; ++bit) {
-            auto i = (x + ((255 - ((y * 8) + bit)) * 224)) * 3;
-
-            if ((byte & (1 << bit)) == 0) {
-              // Black
-              displayFramebuffer[i] = 0x00;
-              displayFramebuffer[i + 1] = 0x00;
-              displayFramebuffer[i + 2] = 0x00;
-            } else if (y > 25 && y < 28) {
-              // Red
-              displayFramebuffer[i] = 0xff;
-              displayFramebuffer[i + 1] = 0x00;
-              displayFramebuffer[i + 2] = 0x00;
-            } else if (y < 10) {
-              // Green
-              displayFramebuffer[i] = 0x00;
-              displayFramebuffer[i + 1] = 0xff;
-              displayFramebuffer[i + 2] = 0x00;
-            } else {
-              // White
-              displayFramebuffer[i] = 0xff;
-              displayFramebuffer[i + 1] = 0xff;
-              displayFramebuffer[i + 2] = 0xff;
-            }
-          }
+      metrics.Begin(invaders::Metrics::SECTION_CONVERSION);
+      if (upscaler) {
+        upscaler->Update(bus.DisplayFrame());
+      } else if (phosphorEnabled) {
+        // Decays once per emulated frame
+        if (emulatedFrames > 0) {
+          phosphor.Apply(bus.DisplayFrame(), displayFramebuffer, overlay);
         }
+      } else {
+        invaders::VRAMToRGB(bus.DisplayFrame(), displayFramebuffer, overlay);
       }
+      metrics.End(invaders::Metrics::SECTION_CONVERSION);
+    }
 
+    const uint8_t *image = upscaler ? upscaler->RGB() : displayFramebuffer;
+    int imageWidth = upscaler ? upscaler->Width() : invaders::kScreenWidth;
+    int imageHeight = upscaler ? upscaler->Height() : invaders::kScreenHeight;
+
+    if (!paused) {
+      metrics.Begin(invaders::Metrics::SECTION_UPLOAD);
       glBindTexture(GL_TEXTURE_2D, displayTexture);
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 224, 256, 0, GL_RGB,
-                   GL_UNSIGNED_BYTE, displayFramebuffer);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, imageWidth, imageHeight, 0,
+                   GL_RGB, GL_UNSIGNED_BYTE, image);
+      metrics.End(invaders::Metrics::SECTION_UPLOAD);
+    }
+
+    // Sequences take every emulated frame, screenshots also work paused
+    if (screenshot || (recording && emulatedFrames > 0)) {
+      capture.Submit(invaders::FrameCapture::FramePath(captureDir, "invaders",
+                                                       bus.FrameCount()),
+                     image, imageWidth, imageHeight);
+      screenshot = false;
     }
 
     // Start the Dear ImGui frame
+    metrics.Begin(invaders::Metrics::SECTION_UI);
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplSDL2_NewFrame();
     ImGui::NewFrame();
@@ -238,10 +436,51 @@ int main(int argc, char **args) {
     {
       ImGui::Begin("General");
       ImGui::Text("Framerate: %f", io.Framerate);
+      ImGui::Text("ROM: %s (%.8s)",
+                  rom->Verified() ? rom->SetName().c_str() : "unknown",
+                  rom->Sha1().c_str());
       if (ImGui::Button(paused ? "Resume" : "Pause")) {
         paused = !paused;
       }
       ImGui::InputInt("Display Scale", &displayScale, 1, 1);
+      if (ImGui::Combo("Filter", &displayFilter, filterNames, 4)) {
+        upscaler.reset();
+        if (displayFilter > 0) {
+          upscaler = std::make_unique<invaders::Upscaler>(
+              (invaders::ScaleFilter)(displayFilter - 1), overlay);
+          upscaler->Update(bus.DisplayFrame());
+        }
+      }
+      ImGui::Checkbox("Phosphor", &phosphorEnabled);
+      ImGui::SameLine();
+      if (ImGui::SliderFloat("Persistence", &persistence, 0.0f, 0.95f)) {
+        phosphor.SetPersistence(persistence);
+      }
+      if (audioDevice != 0 && ImGui::Checkbox("Mute", &muted)) {
+        SDL_PauseAudioDevice(audioDevice, muted);
+      }
+
+      if (ImGui::Button("Screenshot (F12)")) {
+        screenshot = true;
+      }
+      ImGui::SameLine();
+      ImGui::Checkbox("Record PNGs (F11)", &recording);
+      ImGui::Text("PNGs written: %llu, dropped: %llu",
+                  (unsigned long long)capture.Written(),
+                  (unsigned long long)capture.Dropped());
+
+      // The game reads the DIP switches when a game starts
+      auto dips = bus.DipSwitches();
+      int lives = 3 + (dips & invaders::DIP_LIVES);
+      bool bonusAt1000 = dips & invaders::DIP_BONUS_1000;
+      bool coinInfo = !(dips & invaders::DIP_COIN_INFO_OFF);
+      auto changed = ImGui::SliderInt("Lives", &lives, 3, 6);
+      changed |= ImGui::Checkbox("Bonus at 1000", &bonusAt1000);
+      changed |= ImGui::Checkbox("Coin info", &coinInfo);
+      if (changed) {
+        bus.SetDipSwitches(
+            invaders::MakeDipSwitches(lives, bonusAt1000, coinInfo));
+      }
 
       if (displayScale < 1) {
         displayScale = 1;
@@ -252,6 +491,258 @@ int main(int argc, char **args) {
       ImGui::End();
     }
 
+    {
+      ImGui::Begin("Diagnostics");
+
+      auto flag = [&diagnostics](const char *label, uint32_t bit) {
+        bool enabled = (diagnostics & bit) != 0;
+        if (ImGui::Checkbox(label, &enabled)) {
+          diagnostics ^= bit;
+          return true;
+        }
+        return false;
+      };
+
+      bool changed = false;
+      changed |= flag("Trace CPU", invaders::DIAG_TRACE_CPU);
+      changed |= flag("Profile CPU", invaders::DIAG_PROFILE);
+      changed |= flag("Memory statistics", invaders::DIAG_MEM_STATS);
+      changed |= flag("Log interrupts", invaders::DIAG_LOG_INTERRUPTS);
+      changed |= flag("Log memory writes", invaders::DIAG_LOG_MEM_WRITES);
+
+      if (changed) {
+        if ((diagnostics & invaders::DIAG_TRACE_CPU) && !tracer.Running() &&
+            tracer.Start(tracePath)) {
+          bus.cpu.SetTracer(&tracer);
+        }
+        bus.SetDiagnostics(diagnostics);
+      }
+
+      if (tracer.Running()) {
+        ImGui::Text("Tracing to %s", tracePath.c_str());
+        ImGui::Text("Dropped records: %llu",
+                    (unsigned long long)tracer.Dropped());
+      }
+
+      ImGui::End();
+    }
+
+    if (diagnostics & invaders::DIAG_MEM_STATS) {
+      ImGui::Begin("Memory");
+
+      if (ImGui::Button("Reset")) {
+        memStats->Reset();
+      }
+      ImGui::SameLine();
+      if (ImGui::Button("Export CSV")) {
+        std::ofstream memCSV("invaders-mem.csv");
+        memStats->WriteMemoryCSV(memCSV);
+        std::ofstream ioCSV("invaders-io.csv");
+        memStats->WriteIOCSV(ioCSV);
+      }
+
+      memStats->RenderHeatmap(heatmap);
+      glBindTexture(GL_TEXTURE_2D, heatmapTexture);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 256, 256, 0, GL_RGBA,
+                   GL_UNSIGNED_BYTE, heatmap);
+
+      // Address 0x0000 at the top left, one row per 256 bytes
+      ImGui::Text("Reads: green, writes: red");
+      ImGui::Image((void *)(intptr_t)heatmapTexture, ImVec2(512, 512));
+      if (ImGui::IsItemHovered()) {
+        auto min = ImGui::GetItemRectMin();
+        auto mouse = ImGui::GetMousePos();
+        int x = (mouse.x - min.x) / 2;
+        int y = (mouse.y - min.y) / 2;
+        if (x >= 0 && x < 256 && y >= 0 && y < 256) {
+          auto addr = (y << 8) | x;
+          ImGui::SetTooltip("0x%04x\nReads: %llu\nWrites: %llu", addr,
+                            (unsigned long long)memStats->reads[addr],
+                            (unsigned long long)memStats->writes[addr]);
+        }
+      }
+
+      if (ImGui::BeginTable("ports", 4,
+                            ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Port");
+        ImGui::TableSetupColumn("Reads");
+        ImGui::TableSetupColumn("Writes");
+        ImGui::TableSetupColumn("Last write");
+        ImGui::TableHeadersRow();
+
+        for (int port = 0; port < 256; ++port) {
+          if (memStats->ioReads[port] == 0 && memStats->ioWrites[port] == 0) {
+            continue;
+          }
+
+          ImGui::TableNextRow();
+          ImGui::TableNextColumn();
+          ImGui::Text("%d", port);
+          ImGui::TableNextColumn();
+          ImGui::Text("%llu", (unsigned long long)memStats->ioReads[port]);
+          ImGui::TableNextColumn();
+          ImGui::Text("%llu", (unsigned long long)memStats->ioWrites[port]);
+          ImGui::TableNextColumn();
+          ImGui::Text("0x%02x", memStats->ioLastWrite[port]);
+        }
+
+        ImGui::EndTable();
+      }
+
+      ImGui::End();
+    }
+
+    if (diagnostics & invaders::DIAG_PROFILE) {
+      ImGui::Begin("Profiler");
+
+      if (ImGui::Button("Reset")) {
+        profiler.Reset();
+      }
+      ImGui::SameLine();
+      if (ImGui::Button("Export folded stacks")) {
+        std::ofstream folded(profilePath);
+        profiler.WriteFolded(folded);
+      }
+
+      double total = profiler.TotalCycles();
+      if (total == 0) {
+        total = 1;
+      }
+
+      if (ImGui::CollapsingHeader("Routines", ImGuiTreeNodeFlags_DefaultOpen) &&
+          ImGui::BeginTable("routines", 4,
+                            ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
+                                ImGuiTableFlags_ScrollY,
+                            ImVec2(0, 300))) {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("Routine");
+        ImGui::TableSetupColumn("Calls");
+        ImGui::TableSetupColumn("Self %");
+        ImGui::TableSetupColumn("Total %");
+        ImGui::TableHeadersRow();
+
+        for (auto &r : profiler.Routines()) {
+          ImGui::TableNextRow();
+          ImGui::TableNextColumn();
+          ImGui::Text("%s_%04x", r.interrupt ? "int" : "sub", r.address);
+          ImGui::TableNextColumn();
+          ImGui::Text("%llu", (unsigned long long)r.calls);
+          ImGui::TableNextColumn();
+          ImGui::Text("%.2f", 100.0 * r.selfCycles / total);
+          ImGui::TableNextColumn();
+          ImGui::Text("%.2f", 100.0 * r.totalCycles / total);
+        }
+
+        ImGui::EndTable();
+      }
+
+      if (ImGui::CollapsingHeader("Hot PCs", ImGuiTreeNodeFlags_DefaultOpen) &&
+          ImGui::BeginTable("pcs", 3,
+                            ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
+                                ImGuiTableFlags_ScrollY,
+                            ImVec2(0, 300))) {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("PC");
+        ImGui::TableSetupColumn("Executions");
+        ImGui::TableSetupColumn("Cycles %");
+        ImGui::TableHeadersRow();
+
+        for (auto &pc : profiler.HotPCs(100)) {
+          ImGui::TableNextRow();
+          ImGui::TableNextColumn();
+          ImGui::Text("%04x", pc.pc);
+          ImGui::TableNextColumn();
+          ImGui::Text("%llu", (unsigned long long)pc.executions);
+          ImGui::TableNextColumn();
+          ImGui::Text("%.2f", 100.0 * pc.cycles / total);
+        }
+
+        ImGui::EndTable();
+      }
+
+      ImGui::End();
+    }
+
+    {
+      ImGui::Begin("Metrics");
+      ImGui::Text("Emulated: %.3f MHz, %.2f MIPS", metrics.EmulatedMHz(),
+                  metrics.InstructionsPerSecond() / 1e6);
+      ImGui::Text("Host: %.2f ns/instruction",
+                  metrics.HostNanosPerInstruction());
+      ImGui::Text("Frames: %llu emulated, %llu dropped, %llu duplicated",
+                  (unsigned long long)metrics.EmulatedFrames(),
+                  (unsigned long long)metrics.DroppedFrames(),
+                  (unsigned long long)metrics.DuplicatedFrames());
+
+      auto interval = metrics.FrameIntervalSummary();
+      ImGui::Text("Frame interval: p50 %.2f ms, p99 %.2f ms, max %.2f ms",
+                  interval.p50, interval.p99, interval.max);
+      metrics.FrameIntervalSeries().Ordered(metricsPlot);
+      ImGui::PlotLines("Frame time", metricsPlot.data(), metricsPlot.size(), 0,
+                       nullptr, 0.0f, 50.0f, ImVec2(0, 60));
+
+      if (ImGui::BeginTable("sections", 4,
+                            ImGuiTableFlags_Borders |
+                                ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Section");
+        ImGui::TableSetupColumn("p50 ms");
+        ImGui::TableSetupColumn("p99 ms");
+        ImGui::TableSetupColumn("Max ms");
+        ImGui::TableHeadersRow();
+
+        for (int i = 0; i < invaders::Metrics::SECTION_COUNT; ++i) {
+          auto section = (invaders::Metrics::Section)i;
+          auto summary = metrics.SectionSummary(section);
+
+          ImGui::TableNextRow();
+          ImGui::TableNextColumn();
+          ImGui::TextUnformatted(invaders::Metrics::SectionName(section));
+          ImGui::TableNextColumn();
+          ImGui::Text("%.3f", summary.p50);
+          ImGui::TableNextColumn();
+          ImGui::Text("%.3f", summary.p99);
+          ImGui::TableNextColumn();
+          ImGui::Text("%.3f", summary.max);
+        }
+
+        ImGui::EndTable();
+      }
+
+      if (perf && ImGui::BeginTable("perf", 3,
+                                    ImGuiTableFlags_Borders |
+                                        ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Counter");
+        ImGui::TableSetupColumn("Per frame");
+        ImGui::TableSetupColumn("Per M 8080 instr");
+        ImGui::TableHeadersRow();
+
+        auto frames = perfCounters.Intervals();
+        auto instructions = bus.cpu.Instructions();
+
+        for (int i = 0; i < invaders::PerfCounters::PERF_COUNTER_COUNT; ++i) {
+          auto counter = (invaders::PerfCounters::Counter)i;
+          if (!perfCounters.Available(counter)) {
+            continue;
+          }
+
+          auto total = perfCounters.Total(counter);
+
+          ImGui::TableNextRow();
+          ImGui::TableNextColumn();
+          ImGui::TextUnformatted(invaders::PerfCounters::CounterName(counter));
+          ImGui::TableNextColumn();
+          ImGui::Text("%.0f", frames == 0 ? 0.0 : (double)total / frames);
+          ImGui::TableNextColumn();
+          ImGui::Text("%.0f",
+                      instructions == 0 ? 0.0 : total * 1e6 / instructions);
+        }
+
+        ImGui::EndTable();
+      }
+
+      ImGui::End();
+    }
+
     {
       ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0, 0));
       ImGui::Begin("Display", NULL,
@@ -270,11 +761,24 @@ int main(int argc, char **args) {
     glClear(GL_COLOR_BUFFER_BIT);
 
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    metrics.End(invaders::Metrics::SECTION_UI);
 
     SDL_GL_SwapWindow(window);
+
+    metrics.EndFrame(emulatedFrames, droppedFrames, bus.cpu.Instructions(),
+                     bus.cpu.Cycles());
   }
 
   // Cleanup
+  bus.cpu.SetTracer(nullptr);
+  tracer.Stop();
+
+  if (audioDevice != 0) {
+    SDL_CloseAudioDevice(audioDevice);
+    bus.SetAudio(nullptr);
+    audio.Stop();
+  }
+
   ImGui_ImplOpenGL3_Shutdown();
   ImGui_ImplSDL2_Shutdown();
   ImGui::DestroyContext();
@@ -0,0 +1,14 @@
+#include <stdint.h>
+
+namespace invaders {
+#pragma once
+// Memory pages, shared copy-on-write between buses and their clones, and
+// between buses running the same ROM image
+constexpr int kMemPageBits = 10;
+constexpr uint32_t kMemPageSize = 1 << kMemPageBits;
+constexpr int kMemPageCount = (1 << 16) >> kMemPageBits;
+
+struct MemPage {
+  uint8_t data[kMemPageSize] = {0};
+};
+} // namespace invaders
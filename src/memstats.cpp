@@ -0,0 +1,56 @@
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+#include <stdint.h>
+#include <string.h>
+
+#include "memstats.hpp"
+
+namespace invaders {
+void MemoryStats::Reset() {
+  memset(reads, 0, sizeof(reads));
+  memset(writes, 0, sizeof(writes));
+  memset(ioReads, 0, sizeof(ioReads));
+  memset(ioWrites, 0, sizeof(ioWrites));
+  memset(ioLastWrite, 0, sizeof(ioLastWrite));
+}
+
+void MemoryStats::RenderHeatmap(uint8_t *rgba) const {
+  uint64_t maxCount = 1;
+  for (uint32_t addr = 0; addr < (1 << 16); ++addr) {
+    maxCount = std::max({maxCount, reads[addr], writes[addr]});
+  }
+
+  // Log scale so rarely touched cells still show up next to hot loops
+  auto scale = 255.0 / std::log1p((double)maxCount);
+  auto level = [scale](uint64_t count) -> uint8_t {
+    return count == 0 ? 0 : std::max(32.0, std::log1p(count) * scale);
+  };
+
+  for (uint32_t addr = 0; addr < (1 << 16); ++addr) {
+    rgba[addr * 4] = level(writes[addr]);
+    rgba[addr * 4 + 1] = level(reads[addr]);
+    rgba[addr * 4 + 2] = 0;
+    rgba[addr * 4 + 3] = 0xff;
+  }
+}
+
+void MemoryStats::WriteMemoryCSV(std::ostream &out) const {
+  out << "address,reads,writes\n";
+  for (uint32_t addr = 0; addr < (1 << 16); ++addr) {
+    if (reads[addr] != 0 || writes[addr] != 0) {
+      out << addr << ',' << reads[addr] << ',' << writes[addr] << '\n';
+    }
+  }
+}
+
+void MemoryStats::WriteIOCSV(std::ostream &out) const {
+  out << "port,reads,writes,last_write\n";
+  for (uint32_t port = 0; port < 256; ++port) {
+    if (ioReads[port] != 0 || ioWrites[port] != 0) {
+      out << port << ',' << ioReads[port] << ',' << ioWrites[port] << ','
+          << +ioLastWrite[port] << '\n';
+    }
+  }
+}
+} // namespace invaders
@@ -0,0 +1,27 @@
+#include <ostream>
+#include <stdint.h>
+
+namespace invaders {
+#pragma once
+// Per address and per port access counters, filled by the bus while
+// DIAG_MEM_STATS is enabled
+struct MemoryStats {
+  // Includes opcode fetches and writes rejected by the ROM protection
+  uint64_t reads[1 << 16] = {0};
+  uint64_t writes[1 << 16] = {0};
+  uint64_t ioReads[256] = {0};
+  uint64_t ioWrites[256] = {0};
+  // Last value written to each port
+  uint8_t ioLastWrite[256] = {0};
+
+  void Reset();
+
+  // Renders a 256x256 RGBA heatmap, one pixel per address (x = low byte,
+  // y = high byte). Writes are red and reads green, log scaled
+  void RenderHeatmap(uint8_t *rgba) const;
+
+  // CSV with a row per accessed address or port
+  void WriteMemoryCSV(std::ostream &out) const;
+  void WriteIOCSV(std::ostream &out) const;
+};
+} // namespace invaders
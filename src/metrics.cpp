@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <chrono>
+#include <ostream>
+#include <stdint.h>
+#include <vector>
+
+#include "metrics.hpp"
+
+namespace invaders {
+const char *Metrics::SectionName(Section section) {
+  switch (section) {
+  case SECTION_EMULATION: return "emulation";
+  case SECTION_CONVERSION: return "conversion";
+  case SECTION_UPLOAD: return "upload";
+  case SECTION_UI: return "ui";
+  default: return "unknown";
+  }
+}
+
+void Metrics::Series::Add(float value) {
+  values[next] = value;
+  next = (next + 1) % values.size();
+  count = std::min(count + 1, values.size());
+}
+
+Metrics::Summary Metrics::Series::Summarize() const {
+  if (count == 0) {
+    return {0, 0, 0, 0, 0};
+  }
+
+  std::vector<float> sorted(values.begin(), values.begin() + count);
+  std::sort(sorted.begin(), sorted.end());
+
+  double sum = 0;
+  for (auto value : sorted) {
+    sum += value;
+  }
+
+  auto at = [&sorted](double p) { return sorted[(sorted.size() - 1) * p]; };
+  return {sum / count, at(0.5), at(0.95), at(0.99), sorted.back()};
+}
+
+void Metrics::Series::Ordered(std::vector<float> &out) const {
+  out.clear();
+  auto start = count < values.size() ? 0 : next;
+  for (size_t i = 0; i < count; ++i) {
+    out.push_back(values[(start + i) % values.size()]);
+  }
+}
+
+Metrics::Metrics(size_t window)
+    : sections(SECTION_COUNT, Series(window)), frameInterval(window),
+      periodStart(Clock::now()), lastDump(Clock::now()) {}
+
+void Metrics::End(Section section) {
+  std::chrono::duration<double> elapsed = Clock::now() - sectionStart[section];
+  sections[section].Add(elapsed.count() * 1000);
+
+  if (section == SECTION_EMULATION) {
+    emulationSeconds += elapsed.count();
+  }
+}
+
+void Metrics::EndFrame(int emulated, int dropped, uint64_t instructions,
+                       uint64_t cycles) {
+  auto now = Clock::now();
+
+  ++frames;
+  emulatedFrames += emulated;
+  droppedFrames += dropped;
+  if (emulated == 0) {
+    ++duplicatedFrames;
+  }
+
+  if (hasLastFrame) {
+    std::chrono::duration<double, std::milli> interval = now - lastFrame;
+    frameInterval.Add(interval.count());
+  }
+  lastFrame = now;
+  hasLastFrame = true;
+
+  std::chrono::duration<double> period = now - periodStart;
+  if (period.count() >= 1.0) {
+    auto periodInstructionCount = instructions - periodInstructions;
+
+    instructionsPerSecond = periodInstructionCount / period.count();
+    cyclesPerSecond = (cycles - periodCycles) / period.count();
+    hostNanosPerInstruction =
+        periodInstructionCount == 0
+            ? 0
+            : emulationSeconds * 1e9 / periodInstructionCount;
+
+    periodStart = now;
+    periodInstructions = instructions;
+    periodCycles = cycles;
+    emulationSeconds = 0;
+  }
+
+  if (dump != nullptr) {
+    std::chrono::duration<double> sinceDump = now - lastDump;
+    if (sinceDump.count() >= dumpInterval) {
+      WriteJSON(*dump);
+      lastDump = now;
+    }
+  }
+}
+
+void Metrics::SetDump(std::ostream *out, double intervalSeconds) {
+  dump = out;
+  dumpInterval = intervalSeconds;
+  lastDump = Clock::now();
+}
+
+static void WriteSummary(std::ostream &out, const Metrics::Summary &s) {
+  out << "{\"mean\":" << s.mean << ",\"p50\":" << s.p50
+      << ",\"p95\":" << s.p95 << ",\"p99\":" << s.p99 << ",\"max\":" << s.max
+      << '}';
+}
+
+void Metrics::WriteJSON(std::ostream &out) const {
+  auto timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                       .count();
+
+  out << "{\"timestamp_ms\":" << timestamp << ",\"frames\":" << frames
+      << ",\"emulated_frames\":" << emulatedFrames
+      << ",\"dropped_frames\":" << droppedFrames
+      << ",\"duplicated_frames\":" << duplicatedFrames
+      << ",\"instructions_per_second\":" << instructionsPerSecond
+      << ",\"emulated_mhz\":" << cyclesPerSecond / 1e6
+      << ",\"host_ns_per_instruction\":" << hostNanosPerInstruction
+      << ",\"frame_interval_ms\":";
+  WriteSummary(out, frameInterval.Summarize());
+
+  out << ",\"sections_ms\":{";
+  for (int i = 0; i < SECTION_COUNT; ++i) {
+    if (i != 0) {
+      out << ',';
+    }
+    out << '"' << SectionName((Section)i) << "\":";
+    WriteSummary(out, sections[i].Summarize());
+  }
+  out << "}}" << std::endl;
+}
+} // namespace invaders
@@ -0,0 +1,113 @@
+#include <chrono>
+#include <ostream>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace invaders {
+#pragma once
+// Throughput and frame timing metrics for the host loop. Timings are kept in
+// rolling windows for percentiles, rates are recomputed once per second
+class Metrics {
+public:
+  enum Section {
+    SECTION_EMULATION,
+    SECTION_CONVERSION,
+    SECTION_UPLOAD,
+    SECTION_UI,
+    SECTION_COUNT,
+  };
+
+  static const char *SectionName(Section section);
+
+  struct Summary {
+    double mean;
+    double p50;
+    double p95;
+    double p99;
+    double max;
+  };
+
+  // Fixed size ring of samples
+  class Series {
+    std::vector<float> values;
+    size_t next = 0;
+    size_t count = 0;
+
+  public:
+    explicit Series(size_t capacity) : values(capacity) {}
+
+    void Add(float value);
+    Summary Summarize() const;
+    // Samples in insertion order, for plotting
+    void Ordered(std::vector<float> &out) const;
+    size_t Count() const { return count; }
+  };
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  std::vector<Series> sections;
+  Series frameInterval;
+
+  Clock::time_point sectionStart[SECTION_COUNT];
+  // Time spent emulating in the current rate period
+  double emulationSeconds = 0;
+
+  Clock::time_point lastFrame;
+  bool hasLastFrame = false;
+
+  uint64_t frames = 0;
+  uint64_t emulatedFrames = 0;
+  uint64_t droppedFrames = 0;
+  uint64_t duplicatedFrames = 0;
+
+  // Rates, updated once per period
+  Clock::time_point periodStart;
+  uint64_t periodInstructions = 0;
+  uint64_t periodCycles = 0;
+  double instructionsPerSecond = 0;
+  double cyclesPerSecond = 0;
+  double hostNanosPerInstruction = 0;
+
+  std::ostream *dump = nullptr;
+  double dumpInterval = 10;
+  Clock::time_point lastDump;
+
+public:
+  explicit Metrics(size_t window = 600);
+
+  void Begin(Section section) { sectionStart[section] = Clock::now(); }
+  void End(Section section);
+
+  // Ends a host frame. `emulated` is the number of emulated frames run during
+  // it (0 means the previous image was presented again) and `dropped` the
+  // number of emulated frames skipped to catch up with real time.
+  // `instructions` and `cycles` are the CPU's running totals
+  void EndFrame(int emulated, int dropped, uint64_t instructions,
+                uint64_t cycles);
+
+  // Appends a JSON line to `out` every `intervalSeconds`. Pass nullptr to
+  // disable
+  void SetDump(std::ostream *out, double intervalSeconds);
+  void WriteJSON(std::ostream &out) const;
+
+  Summary SectionSummary(Section section) const {
+    return sections[section].Summarize();
+  }
+  const Series &SectionSeries(Section section) const {
+    return sections[section];
+  }
+  Summary FrameIntervalSummary() const { return frameInterval.Summarize(); }
+  const Series &FrameIntervalSeries() const { return frameInterval; }
+
+  uint64_t Frames() const { return frames; }
+  uint64_t EmulatedFrames() const { return emulatedFrames; }
+  uint64_t DroppedFrames() const { return droppedFrames; }
+  uint64_t DuplicatedFrames() const { return duplicatedFrames; }
+
+  double InstructionsPerSecond() const { return instructionsPerSecond; }
+  double EmulatedMHz() const { return cyclesPerSecond / 1e6; }
+  double HostNanosPerInstruction() const { return hostNanosPerInstruction; }
+};
+} // namespace invaders
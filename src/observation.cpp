@@ -0,0 +1,211 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+#include "bus.hpp"
+#include "observation.hpp"
+#include "video.hpp"
+
+namespace invaders {
+namespace {
+// A VRAM column as little endian words, bit 0 being the bottom display pixel.
+// The extra word keeps the extraction of the top rows in bounds
+struct Column {
+  uint64_t words[5] = {0};
+
+  Column() = default;
+  explicit Column(const uint8_t *column) {
+    for (int w = 0; w < 4; ++w) {
+      uint64_t word = 0;
+      for (int b = 7; b >= 0; --b) {
+        word = (word << 8) | column[w * 8 + b];
+      }
+      words[w] = word;
+    }
+  }
+};
+
+// Source boxes of the 84x84 downscale. Output column ox covers the display
+// columns [x0[ox], x0[ox + 1]), output row oy the 3 or 4 column bits starting
+// at bit `shift[oy]` of word `word[oy]`
+struct Box84 {
+  int x0[kSmallSize + 1];
+  int word[kSmallSize];
+  int shift[kSmallSize];
+  uint8_t mask[kSmallSize];
+  int height[kSmallSize];
+  // Lit pixel count to intensity for each box area
+  uint8_t levels[13][13];
+
+  Box84() {
+    for (int i = 0; i <= kSmallSize; ++i) {
+      x0[i] = i * kScreenWidth / kSmallSize;
+    }
+
+    for (int oy = 0; oy < kSmallSize; ++oy) {
+      int y0 = oy * kScreenHeight / kSmallSize;
+      int y1 = (oy + 1) * kScreenHeight / kSmallSize;
+      height[oy] = y1 - y0;
+
+      // Display row y is bit 255 - y of the column
+      int b0 = kScreenHeight - y1;
+      word[oy] = b0 / 64;
+      shift[oy] = b0 % 64;
+      mask[oy] = (1 << height[oy]) - 1;
+    }
+
+    for (int area = 1; area < 13; ++area) {
+      for (int count = 0; count <= area; ++count) {
+        levels[area][count] = (count * 255 + area / 2) / area;
+      }
+    }
+  }
+
+  // The bits of output row oy, which may straddle two words
+  uint32_t Extract(const Column &column, int oy) const {
+    auto *words = column.words + word[oy];
+    auto s = shift[oy];
+    return ((words[0] >> s) | (words[1] << 1 << (63 - s))) & mask[oy];
+  }
+};
+
+const Box84 &Boxes() {
+  static const Box84 boxes;
+  return boxes;
+}
+
+const uint8_t kNibbleBits[16] = {0, 1, 1, 2, 1, 2, 2, 3,
+                                 1, 2, 2, 3, 2, 3, 3, 4};
+} // namespace
+
+bool ParseObservationType(const std::string &name, ObservationType &type) {
+  if (name == "vram") {
+    type = OBS_VRAM_1BPP;
+  } else if (name == "gray") {
+    type = OBS_GRAYSCALE;
+  } else if (name == "ram") {
+    type = OBS_RAM;
+  } else if (name == "gray84") {
+    type = OBS_GRAY_84;
+  } else if (name == "bits84") {
+    type = OBS_BITS_84;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+size_t ObservationSize(ObservationType type) {
+  switch (type) {
+  case OBS_VRAM_1BPP: return kVRAMSize;
+  case OBS_GRAYSCALE: return kGrayscaleWidth * kGrayscaleHeight;
+  case OBS_RAM: return kRAMSize;
+  case OBS_GRAY_84: return kSmallSize * kSmallSize;
+  case OBS_BITS_84: return kBits84RowBytes * kSmallSize;
+  default: return 0;
+  }
+}
+
+bool IsVRAMObservation(ObservationType type) { return type != OBS_RAM; }
+
+void WriteObservation(const Bus &bus, ObservationType type, uint8_t *dst) {
+  switch (type) {
+  case OBS_RAM: {
+    bus.CopyMem(kRAMStart, dst, kRAMSize);
+  } break;
+
+  default: {
+    VRAMToObservation(bus.DisplayFrame(), type, dst);
+  } break;
+  }
+}
+
+void VRAMToObservation(const uint8_t *vram, ObservationType type,
+                       uint8_t *dst) {
+  switch (type) {
+  case OBS_VRAM_1BPP: memcpy(dst, vram, kVRAMSize); break;
+  case OBS_GRAYSCALE: VRAMToGrayscale(vram, dst); break;
+  case OBS_GRAY_84: VRAMToGray84(vram, dst); break;
+  case OBS_BITS_84: VRAMToBits84(vram, dst); break;
+  default: break;
+  }
+}
+
+void VRAMToGrayscale(const uint8_t *vram, uint8_t *dst) {
+  // Number of lit pixels in a 2x2 block to intensity
+  static const uint8_t levels[5] = {0x00, 0x40, 0x80, 0xbf, 0xff};
+
+  for (int ox = 0; ox < kGrayscaleWidth; ++ox) {
+    // Each VRAM line is one display column, bit 0 of the first byte being the
+    // bottom pixel
+    auto *col0 = vram + (ox * 2) * 32;
+    auto *col1 = col0 + 32;
+
+    for (int y = 0; y < 32; ++y) {
+      uint8_t v0 = col0[y];
+      uint8_t v1 = col1[y];
+
+      for (int pair = 0; pair < 4; ++pair) {
+        auto shift = pair * 2;
+        auto count = ((v0 >> shift) & 1) + ((v0 >> (shift + 1)) & 1) +
+                     ((v1 >> shift) & 1) + ((v1 >> (shift + 1)) & 1);
+        auto oy = kGrayscaleHeight - 1 - (y * 4 + pair);
+        dst[oy * kGrayscaleWidth + ox] = levels[count];
+      }
+    }
+  }
+}
+
+void VRAMToGray84(const uint8_t *vram, uint8_t *dst) {
+  auto &boxes = Boxes();
+
+  for (int ox = 0; ox < kSmallSize; ++ox) {
+    auto x0 = boxes.x0[ox], width = boxes.x0[ox + 1] - x0;
+
+    // Adds the 2 or 3 columns of the box bit-parallel into a two bit count
+    // per display row, as a low and a high bit plane
+    Column a(vram + x0 * 32), b(vram + (x0 + 1) * 32), c;
+    if (width == 3) {
+      c = Column(vram + (x0 + 2) * 32);
+    }
+    Column low, high;
+    for (int w = 0; w < 4; ++w) {
+      auto ab = a.words[w] ^ b.words[w];
+      low.words[w] = ab ^ c.words[w];
+      high.words[w] = (a.words[w] & b.words[w]) | (ab & c.words[w]);
+    }
+
+    for (int oy = 0; oy < kSmallSize; ++oy) {
+      auto count = kNibbleBits[boxes.Extract(low, oy)] +
+                   2 * kNibbleBits[boxes.Extract(high, oy)];
+      auto &levels = boxes.levels[width * boxes.height[oy]];
+      dst[oy * kSmallSize + ox] = levels[count];
+    }
+  }
+}
+
+void VRAMToBits84(const uint8_t *vram, uint8_t *dst) {
+  auto &boxes = Boxes();
+  memset(dst, 0, kBits84RowBytes * kSmallSize);
+
+  for (int ox = 0; ox < kSmallSize; ++ox) {
+    // Merging the columns of a box first leaves one test per output pixel
+    Column merged(vram + boxes.x0[ox] * 32);
+    for (int x = boxes.x0[ox] + 1; x < boxes.x0[ox + 1]; ++x) {
+      Column column(vram + x * 32);
+      for (int w = 0; w < 4; ++w) {
+        merged.words[w] |= column.words[w];
+      }
+    }
+
+    uint8_t bit = 0x80 >> (ox % 8);
+    for (int oy = 0; oy < kSmallSize; ++oy) {
+      if (boxes.Extract(merged, oy) != 0) {
+        dst[oy * kBits84RowBytes + ox / 8] |= bit;
+      }
+    }
+  }
+}
+} // namespace invaders
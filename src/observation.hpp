@@ -0,0 +1,61 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include "bus.hpp"
+
+namespace invaders {
+#pragma once
+enum ObservationType {
+  // Displayed video RAM (see Bus::DisplayFrame()), 1 bit per pixel in the
+  // rotated hardware layout
+  OBS_VRAM_1BPP,
+  // Upright 112x128 grayscale image, downscaled 2x2 from the display
+  OBS_GRAYSCALE,
+  // Work RAM and video RAM (0x2000 - 0x3fff)
+  OBS_RAM,
+  // Upright 84x84 grayscale image. Each pixel is the share of lit display
+  // pixels in its 2-3 by 3-4 pixel source box
+  OBS_GRAY_84,
+  // Upright 84x84 bitmap, a pixel is set when any display pixel of its source
+  // box is lit so single pixel wide shots survive. Rows are packed into 11
+  // bytes, most significant bit first
+  OBS_BITS_84,
+};
+
+constexpr uint16_t kRAMStart = 0x2000;
+constexpr uint32_t kRAMSize = 0x2000;
+
+constexpr int kGrayscaleWidth = 112;
+constexpr int kGrayscaleHeight = 128;
+
+constexpr int kSmallSize = 84;
+constexpr int kBits84RowBytes = (kSmallSize + 7) / 8;
+
+// Parses "vram", "gray", "ram", "gray84" or "bits84". Returns false on
+// unknown names
+bool ParseObservationType(const std::string &name, ObservationType &type);
+
+// Size in bytes of a single observation
+size_t ObservationSize(ObservationType type);
+
+// Writes the observation of the current state into `dst`, which must hold
+// ObservationSize(type) bytes. The VRAM based types use the displayed frame
+void WriteObservation(const Bus &bus, ObservationType type, uint8_t *dst);
+
+// True for the types computed from video RAM alone, which is all but OBS_RAM
+bool IsVRAMObservation(ObservationType type);
+
+// Converts a VRAM image into an observation of a VRAM based type
+void VRAMToObservation(const uint8_t *vram, ObservationType type,
+                       uint8_t *dst);
+
+// Downscales a 1bpp VRAM image into a 112x128 upright grayscale image
+void VRAMToGrayscale(const uint8_t *vram, uint8_t *dst);
+
+// Downscales a 1bpp VRAM image to 84x84. Both combine the VRAM columns of a
+// box as 64 bit words first, then read each output pixel with a single shift
+// and mask instead of visiting display pixels
+void VRAMToGray84(const uint8_t *vram, uint8_t *dst);
+void VRAMToBits84(const uint8_t *vram, uint8_t *dst);
+} // namespace invaders
@@ -0,0 +1,30 @@
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+
+#include "options.hpp"
+
+namespace invaders {
+bool ParseNumber(const char *text, int base, uint64_t min, uint64_t max,
+                 uint64_t &value) {
+  // strtoull skips spaces and takes a sign, which would wrap negatives
+  if (!isxdigit((unsigned char)text[0])) {
+    return false;
+  }
+
+  char *end;
+  errno = 0;
+  value = strtoull(text, &end, base);
+  return *end == '\0' && errno == 0 && value >= min && value <= max;
+}
+
+bool ParseNumberOption(const char *option, const char *text, int base,
+                       uint64_t min, uint64_t max, uint64_t &value) {
+  if (ParseNumber(text, base, min, max, value)) {
+    return true;
+  }
+  std::cerr << "Invalid value \"" << text << "\" for " << option << std::endl;
+  return false;
+}
+} // namespace invaders
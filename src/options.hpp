@@ -0,0 +1,16 @@
+#include <stdint.h>
+
+namespace invaders {
+#pragma once
+// Command line helpers shared by the frontends and tools
+
+// Parses the whole of `text` as a number in [min, max]. Empty strings, signs
+// and trailing characters are rejected
+bool ParseNumber(const char *text, int base, uint64_t min, uint64_t max,
+                 uint64_t &value);
+
+// ParseNumber for the value of the command line option `option`. Invalid
+// values are reported on stderr
+bool ParseNumberOption(const char *option, const char *text, int base,
+                       uint64_t min, uint64_t max, uint64_t &value);
+} // namespace invaders
@@ -0,0 +1,207 @@
+#include <iomanip>
+#include <iostream>
+#include <ostream>
+#include <stdint.h>
+#include <utility>
+
+#ifdef __linux__
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "perfcounters.hpp"
+
+namespace invaders {
+const char *PerfCounters::CounterName(Counter counter) {
+  switch (counter) {
+  case PERF_INSTRUCTIONS: return "instructions";
+  case PERF_CYCLES: return "cycles";
+  case PERF_BRANCH_MISSES: return "branch_misses";
+  case PERF_L1D_MISSES: return "l1d_misses";
+  default: return "unknown";
+  }
+}
+
+PerfCounters::PerfCounters() {
+  for (auto &fd : fds) {
+    fd = -1;
+  }
+}
+
+PerfCounters::~PerfCounters() { Close(); }
+
+#ifdef __linux__
+// Counters join the group of `leader`, or lead a new one when it is -1.
+// Reading the leader returns the whole group with the time it was enabled
+// and the time it was actually counting
+static int OpenCounter(uint32_t type, uint64_t config, int leader) {
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = leader < 0;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+  return syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+bool PerfCounters::Open() {
+  Close();
+
+  static const std::pair<uint32_t, uint64_t> events[PERF_COUNTER_COUNT] = {
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+      {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                               (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                               (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+  };
+
+  // The first counter the host supports leads the group
+  for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+    fds[i] = OpenCounter(events[i].first, events[i].second, leader);
+    if (leader < 0) {
+      leader = fds[i];
+    }
+  }
+
+  if (!IsOpen()) {
+    std::cerr << "Unable to open any perf counter: " << strerror(errno)
+              << " (check /proc/sys/kernel/perf_event_paranoid)" << std::endl;
+    return false;
+  }
+
+  for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+    if (fds[i] < 0) {
+      std::cerr << "Perf counter " << CounterName((Counter)i)
+                << " is not supported on this host" << std::endl;
+    }
+  }
+
+  return true;
+}
+
+void PerfCounters::Close() {
+  for (auto &fd : fds) {
+    if (fd >= 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  leader = -1;
+}
+
+void PerfCounters::Start() {
+  if (leader >= 0) {
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+}
+
+void PerfCounters::Stop() {
+  if (leader < 0) {
+    return;
+  }
+  ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+  // Number of counters, time enabled, time running, then the counters in the
+  // order they joined the group
+  uint64_t values[3 + PERF_COUNTER_COUNT];
+  auto size = read(leader, values, sizeof(values));
+  if (size < (ssize_t)(3 * sizeof(uint64_t)) ||
+      size != (ssize_t)((3 + values[0]) * sizeof(uint64_t))) {
+    return;
+  }
+
+  // When the group shared the hardware with other events it only counted
+  // part of the time, extrapolate to the whole interval
+  auto enabled = values[1], running = values[2];
+  auto scale = running == 0 ? 0.0 : (double)enabled / running;
+  timeEnabled += enabled;
+  timeRunning += running;
+
+  for (int i = 0, slot = 3; i < PERF_COUNTER_COUNT; ++i) {
+    if (fds[i] >= 0) {
+      last[i] = (uint64_t)(values[slot++] * scale);
+      totals[i] += last[i];
+    }
+  }
+
+  ++intervals;
+}
+#else
+bool PerfCounters::Open() {
+  std::cerr << "Perf counters are only supported on Linux" << std::endl;
+  return false;
+}
+
+void PerfCounters::Close() {}
+void PerfCounters::Start() {}
+void PerfCounters::Stop() {}
+#endif
+
+bool PerfCounters::IsOpen() const {
+  for (auto fd : fds) {
+    if (fd >= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void PerfCounters::Reset() {
+  for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+    totals[i] = 0;
+    last[i] = 0;
+  }
+  intervals = 0;
+  timeEnabled = 0;
+  timeRunning = 0;
+}
+
+void PerfCounters::WriteReport(std::ostream &out,
+                               uint64_t emulatedInstructions) const {
+  out << "Counter             Per frame   Per M 8080 instr" << std::endl;
+  for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+    if (fds[i] < 0) {
+      continue;
+    }
+
+    out << std::left << std::setw(16) << CounterName((Counter)i) << std::right
+        << std::fixed << std::setprecision(0) << std::setw(13)
+        << (intervals == 0 ? 0.0 : (double)totals[i] / intervals)
+        << std::setw(19)
+        << (emulatedInstructions == 0
+                ? 0.0
+                : totals[i] * 1e6 / emulatedInstructions)
+        << std::endl;
+  }
+
+  if (timeRunning < timeEnabled) {
+    out << "Counters were multiplexed and scaled up from "
+        << std::setprecision(1) << 100.0 * timeRunning / timeEnabled
+        << "% of the time" << std::endl;
+  }
+
+  if (Available(PERF_INSTRUCTIONS) && Available(PERF_CYCLES) &&
+      totals[PERF_CYCLES] != 0) {
+    out << "Host IPC: " << std::setprecision(3)
+        << (double)totals[PERF_INSTRUCTIONS] / totals[PERF_CYCLES] << std::endl;
+  }
+
+  if (Available(PERF_INSTRUCTIONS) && Available(PERF_BRANCH_MISSES) &&
+      totals[PERF_INSTRUCTIONS] != 0) {
+    out << "Branch misses per 1000 host instr: " << std::setprecision(3)
+        << totals[PERF_BRANCH_MISSES] * 1000.0 / totals[PERF_INSTRUCTIONS]
+        << std::endl;
+  }
+}
+} // namespace invaders
@@ -0,0 +1,60 @@
+#include <ostream>
+#include <stdint.h>
+
+namespace invaders {
+#pragma once
+// Host hardware counters (perf_event_open) around a section of code, Linux
+// only. Elsewhere Open() always fails and the rest is a no-op
+class PerfCounters {
+public:
+  enum Counter {
+    PERF_INSTRUCTIONS,
+    PERF_CYCLES,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_COUNTER_COUNT,
+  };
+
+  static const char *CounterName(Counter counter);
+
+private:
+  // -1 when the counter could not be opened. The counters are one group, so
+  // they are scheduled together and read at once through `leader`
+  int fds[PERF_COUNTER_COUNT];
+  int leader = -1;
+  // Counts are scaled to the whole interval when the group was multiplexed
+  uint64_t totals[PERF_COUNTER_COUNT] = {0};
+  uint64_t last[PERF_COUNTER_COUNT] = {0};
+  uint64_t intervals = 0;
+  // Nanoseconds the group was enabled and actually counting
+  uint64_t timeEnabled = 0;
+  uint64_t timeRunning = 0;
+
+public:
+  PerfCounters();
+  ~PerfCounters();
+
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  // Opens every counter the host supports, counting this thread in user
+  // space only. Fails if none could be opened
+  bool Open();
+  void Close();
+  bool IsOpen() const;
+  bool Available(Counter counter) const { return fds[counter] >= 0; }
+
+  // Counts between Start and Stop are added to the totals
+  void Start();
+  void Stop();
+  void Reset();
+
+  uint64_t Total(Counter counter) const { return totals[counter]; }
+  // Counts of the last Start/Stop interval
+  uint64_t Last(Counter counter) const { return last[counter]; }
+  uint64_t Intervals() const { return intervals; }
+
+  // Per interval (frame) and per million emulated instructions
+  void WriteReport(std::ostream &out, uint64_t emulatedInstructions) const;
+};
+} // namespace invaders
@@ -0,0 +1,315 @@
+#include <algorithm>
+#include <iostream>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "checksum.hpp"
+#include "png.hpp"
+
+namespace invaders {
+namespace {
+constexpr int kMaxPaletteSize = 16;
+
+// Deflate limits
+constexpr size_t kWindowSize = 1 << 15;
+constexpr int kMinMatch = 3;
+constexpr int kMaxMatch = 258;
+constexpr int kMaxChain = 16;
+constexpr int kHashBits = 14;
+
+const uint16_t kLengthBase[29] = {3,  4,  5,  6,   7,   8,   9,   10,  11, 13,
+                                  15, 17, 19, 23,  27,  31,  35,  43,  51, 59,
+                                  67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                  1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                  4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t kDistanceBase[30] = {
+    1,   2,   3,   4,   5,   7,    9,    13,   17,   25,
+    33,  49,  65,  97,  129, 193,  257,  385,  513,  769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const uint8_t kDistanceExtra[30] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                    4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                    9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Deflate packs bits starting from the least significant one
+class BitWriter {
+  std::vector<uint8_t> &out;
+  uint64_t buffer = 0;
+  int count = 0;
+
+public:
+  explicit BitWriter(std::vector<uint8_t> &out) : out(out) {}
+
+  void Put(uint32_t bits, int n) {
+    buffer |= (uint64_t)bits << count;
+    count += n;
+    while (count >= 8) {
+      out.push_back(buffer & 0xff);
+      buffer >>= 8;
+      count -= 8;
+    }
+  }
+
+  // Huffman codes are stored starting from their most significant bit
+  void PutCode(uint32_t code, int n) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < n; ++i) {
+      reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    Put(reversed, n);
+  }
+
+  void Flush() {
+    if (count > 0) {
+      out.push_back(buffer & 0xff);
+    }
+    buffer = 0;
+    count = 0;
+  }
+};
+
+// Fixed literal/length code, RFC 1951 section 3.2.6
+void PutSymbol(BitWriter &bits, int symbol) {
+  if (symbol < 144) {
+    bits.PutCode(0x30 + symbol, 8);
+  } else if (symbol < 256) {
+    bits.PutCode(0x190 + symbol - 144, 9);
+  } else if (symbol < 280) {
+    bits.PutCode(symbol - 256, 7);
+  } else {
+    bits.PutCode(0xc0 + symbol - 280, 8);
+  }
+}
+
+void PutMatch(BitWriter &bits, int length, int distance) {
+  int l = 28;
+  while (kLengthBase[l] > length) {
+    --l;
+  }
+  PutSymbol(bits, 257 + l);
+  bits.Put(length - kLengthBase[l], kLengthExtra[l]);
+
+  int d = 29;
+  while (kDistanceBase[d] > distance) {
+    --d;
+  }
+  bits.PutCode(d, 5);
+  bits.Put(distance - kDistanceBase[d], kDistanceExtra[d]);
+}
+
+inline uint32_t Hash3(const uint8_t *p) {
+  return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> (32 - kHashBits);
+}
+
+// zlib stream with a single fixed Huffman block
+std::vector<uint8_t> Deflate(const std::vector<uint8_t> &data) {
+  std::vector<uint8_t> out = {0x78, 0x01};
+  BitWriter bits(out);
+
+  // Final block, fixed codes
+  bits.Put(1, 1);
+  bits.Put(1, 2);
+
+  // Most recent position of each hash and the previous one with the same
+  // hash, both stored + 1 so 0 means none
+  std::vector<uint32_t> head(1 << kHashBits, 0);
+  std::vector<uint32_t> prev(kWindowSize, 0);
+
+  auto size = data.size();
+  size_t pos = 0;
+
+  auto insert = [&](size_t at) {
+    if (at + kMinMatch <= size) {
+      auto h = Hash3(&data[at]);
+      prev[at & (kWindowSize - 1)] = head[h];
+      head[h] = at + 1;
+    }
+  };
+
+  while (pos < size) {
+    int bestLength = 0;
+    size_t bestDistance = 0;
+
+    if (pos + kMinMatch <= size) {
+      auto maxLength = (int)std::min<size_t>(kMaxMatch, size - pos);
+      auto candidate = head[Hash3(&data[pos])];
+
+      for (int chain = 0; chain < kMaxChain && candidate != 0; ++chain) {
+        auto at = candidate - 1;
+        if (pos - at > kWindowSize - 1) {
+          break;
+        }
+
+        int length = 0;
+        while (length < maxLength && data[at + length] == data[pos + length]) {
+          ++length;
+        }
+        if (length > bestLength) {
+          bestLength = length;
+          bestDistance = pos - at;
+          if (length == maxLength) {
+            break;
+          }
+        }
+
+        auto next = prev[at & (kWindowSize - 1)];
+        // Entries older than the window were overwritten
+        if (next >= candidate) {
+          break;
+        }
+        candidate = next;
+      }
+    }
+
+    if (bestLength >= kMinMatch) {
+      PutMatch(bits, bestLength, bestDistance);
+      for (int i = 0; i < bestLength; ++i) {
+        insert(pos + i);
+      }
+      pos += bestLength;
+    } else {
+      PutSymbol(bits, data[pos]);
+      insert(pos);
+      ++pos;
+    }
+  }
+
+  PutSymbol(bits, 256);
+  bits.Flush();
+
+  auto adler = Adler32(data.data(), data.size());
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    out.push_back((adler >> shift) & 0xff);
+  }
+
+  return out;
+}
+
+void PutChunk(std::vector<uint8_t> &png, const char *type,
+              const std::vector<uint8_t> &data) {
+  auto put32 = [&png](uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      png.push_back((value >> shift) & 0xff);
+    }
+  };
+
+  put32(data.size());
+  auto start = png.size();
+  png.insert(png.end(), type, type + 4);
+  png.insert(png.end(), data.begin(), data.end());
+  put32(Crc32(png.data() + start, png.size() - start));
+}
+
+// Collects the palette, fails if the image has too many colors
+bool BuildPalette(const uint8_t *rgb, size_t pixels,
+                  std::vector<uint32_t> &palette, std::vector<uint8_t> &index) {
+  index.resize(pixels);
+  uint32_t last = 0xffffffff;
+  uint8_t lastIndex = 0;
+
+  for (size_t i = 0; i < pixels; ++i) {
+    uint32_t color = rgb[i * 3] << 16 | rgb[i * 3 + 1] << 8 | rgb[i * 3 + 2];
+    if (color != last) {
+      auto found = std::find(palette.begin(), palette.end(), color);
+      if (found == palette.end()) {
+        if (palette.size() == kMaxPaletteSize) {
+          return false;
+        }
+        found = palette.insert(palette.end(), color);
+      }
+      last = color;
+      lastIndex = found - palette.begin();
+    }
+    index[i] = lastIndex;
+  }
+
+  return true;
+}
+} // namespace
+
+std::vector<uint8_t> EncodePNG(const uint8_t *rgb, int width, int height) {
+  std::vector<uint32_t> palette;
+  std::vector<uint8_t> index;
+  bool indexed = BuildPalette(rgb, (size_t)width * height, palette, index);
+
+  int depth = 8;
+  if (indexed) {
+    depth = palette.size() <= 2 ? 1 : palette.size() <= 4 ? 2 : 4;
+  }
+
+  // Every row starts with its filter type. Palette rows are left unfiltered,
+  // true color rows use the Up filter
+  size_t rowBytes = indexed ? ((size_t)width * depth + 7) / 8 : width * 3;
+  std::vector<uint8_t> raw((rowBytes + 1) * height, 0);
+
+  for (int y = 0; y < height; ++y) {
+    auto *row = &raw[y * (rowBytes + 1)];
+
+    if (indexed) {
+      for (int x = 0; x < width; ++x) {
+        auto shift = 8 - depth - (x * depth) % 8;
+        row[1 + x * depth / 8] |= index[(size_t)y * width + x] << shift;
+      }
+    } else {
+      row[0] = 2;
+      auto *current = rgb + (size_t)y * rowBytes;
+      auto *above = y > 0 ? current - rowBytes : nullptr;
+      for (size_t i = 0; i < rowBytes; ++i) {
+        row[1 + i] = current[i] - (above != nullptr ? above[i] : 0);
+      }
+    }
+  }
+
+  std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+  std::vector<uint8_t> header = {
+      (uint8_t)(width >> 24),  (uint8_t)(width >> 16),
+      (uint8_t)(width >> 8),   (uint8_t)width,
+      (uint8_t)(height >> 24), (uint8_t)(height >> 16),
+      (uint8_t)(height >> 8),  (uint8_t)height,
+      (uint8_t)depth,
+      // Palette or true color
+      (uint8_t)(indexed ? 3 : 2),
+      // Deflate, adaptive filtering, no interlacing
+      0, 0, 0};
+  PutChunk(png, "IHDR", header);
+
+  if (indexed) {
+    std::vector<uint8_t> plte;
+    for (auto color : palette) {
+      plte.push_back(color >> 16);
+      plte.push_back((color >> 8) & 0xff);
+      plte.push_back(color & 0xff);
+    }
+    PutChunk(png, "PLTE", plte);
+  }
+
+  PutChunk(png, "IDAT", Deflate(raw));
+  PutChunk(png, "IEND", {});
+
+  return png;
+}
+
+bool WritePNG(const std::string path, const uint8_t *rgb, int width,
+              int height) {
+  auto png = EncodePNG(rgb, width, height);
+
+  auto *file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "Unable to open \"" << path << "\"" << std::endl;
+    return false;
+  }
+
+  bool written = fwrite(png.data(), 1, png.size(), file) == png.size();
+  written &= fclose(file) == 0;
+  if (!written) {
+    std::cerr << "Unable to write \"" << path << "\"" << std::endl;
+  }
+
+  return written;
+}
+} // namespace invaders
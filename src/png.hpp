@@ -0,0 +1,17 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace invaders {
+#pragma once
+// Encodes an RGB888 image as a PNG. Images with up to 16 colors, like every
+// emulated frame, are written as 1, 2 or 4 bit palette images, which is
+// several times smaller and faster to compress than true color. The data is
+// compressed with LZ77 and the fixed deflate Huffman codes, good enough for
+// these images without bundling zlib
+std::vector<uint8_t> EncodePNG(const uint8_t *rgb, int width, int height);
+
+bool WritePNG(const std::string path, const uint8_t *rgb, int width,
+              int height);
+} // namespace invaders
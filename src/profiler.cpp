@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include "profiler.hpp"
+
+namespace invaders {
+// Deeper shadow stacks are almost certainly a routine dropping its return
+// address, stop descending
+static const size_t kMaxDepth = 256;
+
+Profiler::Profiler() { Reset(); }
+
+void Profiler::Reset() {
+  executions.assign(1 << 16, 0);
+  cycles.assign(1 << 16, 0);
+  nodes.clear();
+  nodes.push_back({0, false, 0, 0, 0});
+  children.clear();
+  stack.clear();
+  current = 0;
+}
+
+void Profiler::Enter(uint16_t address, uint16_t sp, bool interrupt) {
+  // Frames at or below the new return address were unwound without a RET
+  while (!stack.empty() && stack.back().entrySp <= sp) {
+    stack.pop_back();
+  }
+  current = stack.empty() ? 0 : stack.back().node;
+
+  if (stack.size() >= kMaxDepth) {
+    return;
+  }
+
+  uint64_t key = ((uint64_t)current << 17) | ((uint64_t)interrupt << 16) |
+                 address;
+  auto it = children.find(key);
+
+  uint32_t node;
+  if (it == children.end()) {
+    node = nodes.size();
+    nodes.push_back({address, interrupt, current, 0, 0});
+    children.emplace(key, node);
+  } else {
+    node = it->second;
+  }
+
+  ++nodes[node].calls;
+  stack.push_back({node, sp});
+  current = node;
+}
+
+void Profiler::Return(uint16_t sp) {
+  // Pop every frame whose return address is now above SP
+  while (!stack.empty() && stack.back().entrySp < sp) {
+    stack.pop_back();
+  }
+  current = stack.empty() ? 0 : stack.back().node;
+}
+
+uint64_t Profiler::TotalCycles() const {
+  uint64_t total = 0;
+  for (auto &node : nodes) {
+    total += node.selfCycles;
+  }
+  return total;
+}
+
+std::vector<Profiler::PCStats> Profiler::HotPCs(size_t limit) const {
+  std::vector<PCStats> stats;
+  for (uint32_t pc = 0; pc < (1 << 16); ++pc) {
+    if (executions[pc] != 0) {
+      stats.push_back({(uint16_t)pc, executions[pc], cycles[pc]});
+    }
+  }
+
+  limit = std::min(limit, stats.size());
+  std::partial_sort(stats.begin(), stats.begin() + limit, stats.end(),
+                    [](const PCStats &a, const PCStats &b) {
+                      return a.cycles > b.cycles;
+                    });
+  stats.resize(limit);
+
+  return stats;
+}
+
+std::vector<Profiler::RoutineStats> Profiler::Routines() const {
+  // Children are always created after their parent, so a reverse walk sees
+  // every child before its parent
+  std::vector<uint64_t> inclusive(nodes.size());
+  for (size_t i = nodes.size(); i-- > 1;) {
+    inclusive[i] += nodes[i].selfCycles;
+    inclusive[nodes[i].parent] += inclusive[i];
+  }
+
+  std::unordered_map<uint32_t, RoutineStats> routines;
+  for (size_t i = 1; i < nodes.size(); ++i) {
+    auto &node = nodes[i];
+    uint32_t key = ((uint32_t)node.interrupt << 16) | node.address;
+
+    auto &stats = routines[key];
+    stats.address = node.address;
+    stats.interrupt = node.interrupt;
+    stats.calls += node.calls;
+    stats.selfCycles += node.selfCycles;
+
+    // Only count the outermost activation of recursive routines
+    bool recursive = false;
+    for (auto p = node.parent; p != 0; p = nodes[p].parent) {
+      if (nodes[p].address == node.address &&
+          nodes[p].interrupt == node.interrupt) {
+        recursive = true;
+        break;
+      }
+    }
+    if (!recursive) {
+      stats.totalCycles += inclusive[i];
+    }
+  }
+
+  std::vector<RoutineStats> sorted;
+  for (auto &entry : routines) {
+    sorted.push_back(entry.second);
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](const RoutineStats &a, const RoutineStats &b) {
+              return a.totalCycles > b.totalCycles;
+            });
+
+  return sorted;
+}
+
+void Profiler::AppendPath(uint32_t node, std::ostream &out) const {
+  if (node == 0) {
+    out << "root";
+    return;
+  }
+
+  AppendPath(nodes[node].parent, out);
+  out << ';' << (nodes[node].interrupt ? "int_" : "sub_") << std::hex
+      << std::setw(4) << std::setfill('0') << nodes[node].address;
+}
+
+void Profiler::WriteFolded(std::ostream &out) const {
+  for (uint32_t i = 0; i < nodes.size(); ++i) {
+    if (nodes[i].selfCycles == 0) {
+      continue;
+    }
+
+    AppendPath(i, out);
+    out << ' ' << std::dec << nodes[i].selfCycles << '\n';
+  }
+}
+} // namespace invaders
@@ -0,0 +1,85 @@
+#include <ostream>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+namespace invaders {
+#pragma once
+// Exact (non sampling) execution profiler. Counts executions and cycles per
+// PC and attributes cycles to a call tree built from CALL, RET, RST and
+// interrupts. Enabled through DIAG_PROFILE
+class Profiler {
+public:
+  struct PCStats {
+    uint16_t pc;
+    uint64_t executions;
+    uint64_t cycles;
+  };
+
+  struct RoutineStats {
+    uint16_t address;
+    bool interrupt;
+    uint64_t calls;
+    uint64_t selfCycles;
+    // Including callees. Recursive calls are only counted once
+    uint64_t totalCycles;
+  };
+
+private:
+  struct Node {
+    uint16_t address;
+    bool interrupt;
+    uint32_t parent;
+    uint64_t calls;
+    uint64_t selfCycles;
+  };
+
+  // Shadow of the CPU call stack
+  struct Frame {
+    uint32_t node;
+    // SP right after the return address was pushed
+    uint16_t entrySp;
+  };
+
+  std::vector<uint64_t> executions;
+  std::vector<uint64_t> cycles;
+
+  // Node 0 is the root, code running outside of any known call
+  std::vector<Node> nodes;
+  // (parent << 17 | interrupt << 16 | address) to node index
+  std::unordered_map<uint64_t, uint32_t> children;
+  std::vector<Frame> stack;
+  uint32_t current = 0;
+
+  void Enter(uint16_t address, uint16_t sp, bool interrupt);
+  void AppendPath(uint32_t node, std::ostream &out) const;
+
+public:
+  Profiler();
+
+  void Reset();
+
+  inline void Instruction(uint16_t pc, uint8_t instructionCycles) {
+    ++executions[pc];
+    cycles[pc] += instructionCycles;
+    nodes[current].selfCycles += instructionCycles;
+  }
+
+  // Called after a taken CALL or RST, or an interrupt, with the new PC and SP
+  void Call(uint16_t target, uint16_t sp) { Enter(target, sp, false); }
+  void Interrupt(uint16_t target, uint16_t sp) { Enter(target, sp, true); }
+  // Called after a taken RET with the new SP
+  void Return(uint16_t sp);
+
+  uint64_t TotalCycles() const;
+
+  // Returns the `limit` hottest PCs, sorted by cycles
+  std::vector<PCStats> HotPCs(size_t limit) const;
+  // Returns the routines sorted by total cycles
+  std::vector<RoutineStats> Routines() const;
+
+  // Writes the call tree in the folded stack format used by flamegraph.pl
+  // and speedscope, weighted by cycles
+  void WriteFolded(std::ostream &out) const;
+};
+} // namespace invaders
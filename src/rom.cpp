@@ -0,0 +1,275 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "checksum.hpp"
+#include "hash.hpp"
+#include "rom.hpp"
+
+namespace invaders {
+namespace {
+struct ROMFile {
+  const char *name;
+  uint16_t address;
+  uint16_t size;
+  uint32_t crc32;
+  const char *sha1;
+};
+
+// Midway Space Invaders, as listed by MAME
+const char *const kInvadersSetName = "invaders";
+const ROMFile kInvadersSet[] = {
+    {"invaders.h", 0x0000, 0x0800, 0x734f5ad8,
+     "ff6200af4c9110d8181249cbcef1a8a40fa40b7f"},
+    {"invaders.g", 0x0800, 0x0800, 0x6bfaca4a,
+     "16f48649b531bdef8c2d1446c429b5f414524350"},
+    {"invaders.f", 0x1000, 0x0800, 0x0ccead96,
+     "537aef03468f63c5b9e11dd61e253f7ae17d9743"},
+    {"invaders.e", 0x1800, 0x0800, 0x14e538b0,
+     "1d6ca0c99f9df71e2990b610deb9d7da0125e2d8"},
+};
+constexpr size_t kInvadersSetSize = 0x2000;
+
+bool Matches(const ROMFile &file, const uint8_t *data, size_t size) {
+  return size == file.size && Crc32(data, size) == file.crc32 &&
+         Sha1(data, size) == file.sha1;
+}
+
+// Identifies a file's contents without reading them
+struct FileStamp {
+  std::string path;
+  uintmax_t size;
+  std::filesystem::file_time_type time;
+
+  bool operator==(const FileStamp &other) const {
+    return path == other.path && size == other.size && time == other.time;
+  }
+};
+
+bool Stamp(const std::string &path, FileStamp &stamp) {
+  std::error_code error;
+  stamp.path = path;
+  stamp.size = std::filesystem::file_size(path, error);
+  if (error) {
+    return false;
+  }
+  stamp.time = std::filesystem::last_write_time(path, error);
+  return !error;
+}
+
+struct Cache {
+  std::mutex mutex;
+
+  struct PathEntry {
+    std::vector<FileStamp> stamps;
+    std::shared_ptr<const ROM> rom;
+  };
+  std::unordered_map<std::string, PathEntry> byPath;
+  std::unordered_map<std::string, std::shared_ptr<const ROM>> bySha1;
+};
+
+Cache &ROMCache() {
+  static Cache cache;
+  return cache;
+}
+
+// Assembles a split set. Fails on missing files or unexpected sizes, and
+// loads the set unverified when the contents do not match
+bool AssembleSet(const std::string &dir, std::vector<uint8_t> &image,
+                 bool &verified) {
+  image.assign(kInvadersSetSize, 0);
+  verified = true;
+
+  for (auto &file : kInvadersSet) {
+    auto path = (std::filesystem::path(dir) / file.name).string();
+
+    MappedFile mapped;
+    if (!mapped.Open(path)) {
+      return false;
+    }
+    if (mapped.Size() != file.size) {
+      std::cerr << "\"" << path << "\" should be " << file.size
+                << " bytes, not " << mapped.Size() << std::endl;
+      return false;
+    }
+
+    if (!Matches(file, mapped.Data(), mapped.Size())) {
+      std::cerr << "\"" << path << "\" does not match the known "
+                << kInvadersSetName << " set" << std::endl;
+      verified = false;
+    }
+
+    memcpy(image.data() + file.address, mapped.Data(), mapped.Size());
+  }
+
+  return true;
+}
+
+// A single image is verified when it is the split set laid out back to back
+bool IsKnownImage(const std::vector<uint8_t> &image) {
+  if (image.size() != kInvadersSetSize) {
+    return false;
+  }
+
+  return std::all_of(std::begin(kInvadersSet), std::end(kInvadersSet),
+                     [&image](const ROMFile &file) {
+                       return Matches(file, image.data() + file.address,
+                                      file.size);
+                     });
+}
+} // namespace
+
+MappedFile::~MappedFile() { Close(); }
+
+bool MappedFile::Open(const std::string &path) {
+  Close();
+
+#if defined(__unix__) || defined(__APPLE__)
+  auto fd = open(path.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd >= 0 && fstat(fd, &st) == 0) {
+    size = st.st_size;
+    if (size == 0) {
+      close(fd);
+      return true;
+    }
+
+    auto *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped != MAP_FAILED) {
+      mapping = mapped;
+      data = (const uint8_t *)mapped;
+      return true;
+    }
+  } else if (fd >= 0) {
+    close(fd);
+  }
+  size = 0;
+#endif
+
+  // Fall back to reading the whole file at once
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) {
+    std::cerr << "Unable to open \"" << path << "\"" << std::endl;
+    return false;
+  }
+
+  buffer.resize(file.tellg());
+  file.seekg(0);
+  if (!file.read((char *)buffer.data(), buffer.size())) {
+    std::cerr << "Unable to read \"" << path << "\"" << std::endl;
+    buffer.clear();
+    return false;
+  }
+
+  data = buffer.data();
+  size = buffer.size();
+  return true;
+}
+
+void MappedFile::Close() {
+#if defined(__unix__) || defined(__APPLE__)
+  if (mapping != nullptr) {
+    munmap(mapping, size);
+  }
+#endif
+  mapping = nullptr;
+  buffer.clear();
+  data = nullptr;
+  size = 0;
+}
+
+ROM::ROM(const std::vector<uint8_t> &image, std::string setName)
+    : size(image.size()), sha1(invaders::Sha1(image.data(), image.size())),
+      setName(std::move(setName)) {
+  for (size_t start = 0; start < size; start += kMemPageSize) {
+    auto page = std::make_shared<MemPage>();
+    auto chunk = std::min<size_t>(kMemPageSize, size - start);
+    memcpy(page->data, image.data() + start, chunk);
+
+    uint64_t hash = 0;
+    for (uint32_t i = 0; i < kMemPageSize; ++i) {
+      hash += HashMemCell(start + i, page->data[i]);
+    }
+
+    pages.push_back(page);
+    pageHashes.push_back(hash);
+  }
+}
+
+std::shared_ptr<const ROM> LoadROM(const std::string &path) {
+  auto &cache = ROMCache();
+  std::lock_guard<std::mutex> lock(cache.mutex);
+
+  std::error_code error;
+  bool split = std::filesystem::is_directory(path, error);
+
+  std::vector<FileStamp> stamps;
+  if (split) {
+    for (auto &file : kInvadersSet) {
+      stamps.emplace_back();
+      Stamp((std::filesystem::path(path) / file.name).string(),
+            stamps.back());
+    }
+  } else {
+    stamps.emplace_back();
+    Stamp(path, stamps.back());
+  }
+
+  // Unchanged files, nothing to read
+  auto cached = cache.byPath.find(path);
+  if (cached != cache.byPath.end() && cached->second.stamps == stamps) {
+    return cached->second.rom;
+  }
+
+  std::vector<uint8_t> image;
+  bool verified;
+
+  if (split) {
+    if (!AssembleSet(path, image, verified)) {
+      return nullptr;
+    }
+  } else {
+    MappedFile mapped;
+    if (!mapped.Open(path)) {
+      return nullptr;
+    }
+    if (mapped.Size() > (1 << 16)) {
+      std::cerr << "\"" << path << "\" does not fit in the address space"
+                << std::endl;
+      return nullptr;
+    }
+
+    image.assign(mapped.Data(), mapped.Data() + mapped.Size());
+    verified = IsKnownImage(image);
+  }
+
+  auto rom = std::make_shared<const ROM>(image, verified ? kInvadersSetName
+                                                         : "");
+
+  // Identical images loaded from different paths share their pages
+  auto &shared = cache.bySha1[rom->Sha1()];
+  if (shared == nullptr) {
+    shared = rom;
+  }
+
+  cache.byPath[path] = {stamps, shared};
+  return shared;
+}
+} // namespace invaders
@@ -0,0 +1,67 @@
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "mempage.hpp"
+
+namespace invaders {
+#pragma once
+// Read only view of a whole file, memory mapped where supported and read in
+// one go otherwise
+class MappedFile {
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+  void *mapping = nullptr;
+  std::vector<uint8_t> buffer;
+
+public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool Open(const std::string &path);
+  void Close();
+
+  const uint8_t *Data() const { return data; }
+  size_t Size() const { return size; }
+};
+
+// Immutable ROM image mapped from 0x0000, split into memory pages which are
+// shared by every bus running it
+class ROM {
+  std::vector<std::shared_ptr<const MemPage>> pages;
+  // Sum of HashMemCell() over each page, see Bus::LoadROM()
+  std::vector<uint64_t> pageHashes;
+  size_t size;
+  std::string sha1;
+  std::string setName;
+
+public:
+  // `image` must fit in the address space
+  ROM(const std::vector<uint8_t> &image, std::string setName);
+
+  size_t Size() const { return size; }
+  size_t PageCount() const { return pages.size(); }
+  const std::shared_ptr<const MemPage> &Page(size_t index) const {
+    return pages[index];
+  }
+  uint64_t PageHash(size_t index) const { return pageHashes[index]; }
+
+  // SHA-1 of the image, as a lowercase hex string
+  const std::string &Sha1() const { return sha1; }
+  // Name of the known set the image matched, empty for unknown images
+  const std::string &SetName() const { return setName; }
+  bool Verified() const { return !setName.empty(); }
+};
+
+// Loads a ROM image from a single file or from a directory holding a split
+// set (invaders.h, invaders.g, invaders.f and invaders.e). Files are checked
+// against the CRC-32 and SHA-1 of the known sets. Images are cached by path
+// and by hash, so loading the same ROM again only checks the file stamps.
+// Returns nullptr on error. Thread safe
+std::shared_ptr<const ROM> LoadROM(const std::string &path);
+} // namespace invaders
@@ -0,0 +1,105 @@
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stddef.h>
+#include <thread>
+#include <vector>
+
+namespace invaders {
+#pragma once
+// Wait-free single producer, single consumer ring buffer. The capacity is
+// rounded up to a power of two
+template <typename T> class SpscRing {
+  std::unique_ptr<T[]> items;
+  size_t mask;
+
+  // Written by the consumer
+  alignas(64) std::atomic<size_t> head{0};
+  // Written by the producer
+  alignas(64) std::atomic<size_t> tail{0};
+  // Producer's last view of `head`, avoids touching the consumer's cache
+  // line on every push
+  alignas(64) size_t cachedHead = 0;
+
+public:
+  explicit SpscRing(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    items = std::make_unique<T[]>(size);
+    mask = size - 1;
+  }
+
+  size_t Capacity() const { return mask + 1; }
+
+  // Producer side. Returns false if the ring is full
+  bool TryPush(const T &item) {
+    auto t = tail.load(std::memory_order_relaxed);
+    if (t - cachedHead > mask) {
+      cachedHead = head.load(std::memory_order_acquire);
+      if (t - cachedHead > mask) {
+        return false;
+      }
+    }
+
+    items[t & mask] = item;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Pops up to `max` items into `dst` and returns the count
+  size_t PopBatch(T *dst, size_t max) {
+    auto h = head.load(std::memory_order_relaxed);
+    auto available = tail.load(std::memory_order_acquire) - h;
+    auto count = available < max ? available : max;
+
+    for (size_t i = 0; i < count; ++i) {
+      dst[i] = items[(h + i) & mask];
+    }
+
+    head.store(h + count, std::memory_order_release);
+    return count;
+  }
+
+  bool TryPop(T &item) { return PopBatch(&item, 1) == 1; }
+
+  // Consumer side. Returns the oldest item without popping it, or nullptr
+  const T *Peek() const {
+    auto h = head.load(std::memory_order_relaxed);
+    if (tail.load(std::memory_order_acquire) == h) {
+      return nullptr;
+    }
+    return &items[h & mask];
+  }
+
+  // Approximate when called concurrently
+  size_t Size() const {
+    return tail.load(std::memory_order_acquire) -
+           head.load(std::memory_order_acquire);
+  }
+};
+
+// Consumer loop of a worker thread. Hands up to `batchSize` items at a time to
+// `handler(items, count)` and sleeps while the ring is empty. Returns once
+// `running` is cleared and everything pushed before that has been handled
+template <typename T, typename Handler>
+void DrainUntilStopped(SpscRing<T> &ring, const std::atomic<bool> &running,
+                       size_t batchSize, Handler handler) {
+  std::vector<T> batch(batchSize);
+
+  while (true) {
+    // Read the flag before draining so nothing pushed before the stop is lost
+    bool stop = !running.load(std::memory_order_acquire);
+    auto count = ring.PopBatch(batch.data(), batch.size());
+
+    if (count > 0) {
+      handler(batch.data(), count);
+    } else if (stop) {
+      break;
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+}
+} // namespace invaders
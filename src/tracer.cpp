@@ -0,0 +1,73 @@
+#include <iostream>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+
+#include "tracer.hpp"
+
+namespace invaders {
+Tracer::Tracer(size_t capacity) : ring(capacity) {}
+
+Tracer::~Tracer() { Stop(); }
+
+bool Tracer::Start(const std::string path) {
+  Stop();
+
+  file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "Unable to open trace file \"" << path << "\"" << std::endl;
+    return false;
+  }
+
+  TraceHeader header = {kTraceMagic, kTraceVersion, sizeof(TraceRecord), 0};
+  fwrite(&header, sizeof(header), 1, file);
+
+  dropped = 0;
+  running = true;
+  writer = std::thread(&Tracer::WriterLoop, this);
+
+  return true;
+}
+
+void Tracer::Stop() {
+  if (!running) {
+    return;
+  }
+
+  running = false;
+  writer.join();
+
+  fclose(file);
+  file = nullptr;
+
+  if (dropped > 0) {
+    std::cerr << "Tracer dropped " << dropped << " records" << std::endl;
+  }
+}
+
+void Tracer::WriterLoop() {
+  uint64_t reportedDrops = 0;
+
+  // Marks where records were lost since the last call
+  auto writeGap = [&]() {
+    auto drops = dropped.load(std::memory_order_relaxed);
+    if (drops != reportedDrops) {
+      TraceRecord gap = {};
+      gap.cycle = drops - reportedDrops;
+      gap.gap = 1;
+      fwrite(&gap, sizeof(gap), 1, file);
+      reportedDrops = drops;
+    }
+  };
+
+  DrainUntilStopped(ring, running, 1 << 14,
+                    [&](const TraceRecord *batch, size_t count) {
+                      fwrite(batch, sizeof(TraceRecord), count, file);
+                      writeGap();
+                    });
+  writeGap();
+
+  fflush(file);
+}
+} // namespace invaders
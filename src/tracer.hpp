@@ -0,0 +1,76 @@
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+
+#include "spsc.hpp"
+
+namespace invaders {
+#pragma once
+// A single executed instruction. Records are written to the trace file as is
+// (host byte order, little-endian on every supported target)
+struct TraceRecord {
+  // Cycle at which the instruction was fetched
+  uint64_t cycle;
+  uint16_t pc;
+  uint16_t sp;
+  uint8_t opcode;
+  uint8_t a;
+  uint8_t b;
+  uint8_t c;
+  uint8_t d;
+  uint8_t e;
+  uint8_t h;
+  uint8_t l;
+  uint8_t flags;
+  // Non zero for a gap marker, `cycle` then holds the number of records
+  // dropped because the writer could not keep up
+  uint8_t gap;
+  uint8_t pad[2];
+};
+
+static_assert(sizeof(TraceRecord) == 24, "TraceRecord must stay 24 bytes");
+
+// Trace file header
+struct TraceHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t recordSize;
+  uint32_t reserved;
+};
+
+constexpr uint32_t kTraceMagic = 0x54564e49; // "INVT"
+constexpr uint32_t kTraceVersion = 1;
+
+// Collects execution records in a lock-free ring buffer and streams them to a
+// file from a background thread. The emulation thread never blocks: when the
+// ring is full records are dropped and a gap marker is written instead
+class Tracer {
+  SpscRing<TraceRecord> ring;
+  std::atomic<uint64_t> dropped{0};
+
+  FILE *file = nullptr;
+  std::thread writer;
+  std::atomic<bool> running{false};
+
+  void WriterLoop();
+
+public:
+  explicit Tracer(size_t capacity = 1 << 20);
+  ~Tracer();
+
+  bool Start(const std::string path);
+  // Flushes the remaining records and closes the file
+  void Stop();
+
+  bool Running() const { return running.load(std::memory_order_relaxed); }
+  uint64_t Dropped() const { return dropped.load(std::memory_order_relaxed); }
+
+  inline void Record(const TraceRecord &record) {
+    if (!ring.TryPush(record)) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+};
+} // namespace invaders
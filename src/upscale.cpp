@@ -0,0 +1,253 @@
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "bus.hpp"
+#include "upscale.hpp"
+#include "video.hpp"
+
+namespace invaders {
+namespace {
+using Row = Upscaler::Row;
+
+// Clears the bits past pixel 223
+constexpr uint64_t kLastWordMask = ((uint64_t)1 << (kScreenWidth - 192)) - 1;
+
+inline Row operator&(const Row &a, const Row &b) {
+  return {{a.w[0] & b.w[0], a.w[1] & b.w[1], a.w[2] & b.w[2], a.w[3] & b.w[3]}};
+}
+inline Row operator|(const Row &a, const Row &b) {
+  return {{a.w[0] | b.w[0], a.w[1] | b.w[1], a.w[2] | b.w[2], a.w[3] | b.w[3]}};
+}
+inline Row operator^(const Row &a, const Row &b) {
+  return {{a.w[0] ^ b.w[0], a.w[1] ^ b.w[1], a.w[2] ^ b.w[2], a.w[3] ^ b.w[3]}};
+}
+inline Row operator~(const Row &a) {
+  return {{~a.w[0], ~a.w[1], ~a.w[2], ~a.w[3]}};
+}
+inline bool operator!=(const Row &a, const Row &b) {
+  return ((a.w[0] ^ b.w[0]) | (a.w[1] ^ b.w[1]) | (a.w[2] ^ b.w[2]) |
+          (a.w[3] ^ b.w[3])) != 0;
+}
+
+// Pixel x of the result is pixel x + n of `r`, for n in [-2, 2]
+inline Row Shift(const Row &r, int n) {
+  Row out;
+  if (n > 0) {
+    for (int i = 0; i < 4; ++i) {
+      auto next = i < 3 ? r.w[i + 1] : 0;
+      out.w[i] = (r.w[i] >> n) | (next << (64 - n));
+    }
+  } else if (n < 0) {
+    for (int i = 0; i < 4; ++i) {
+      auto prev = i > 0 ? r.w[i - 1] : 0;
+      out.w[i] = (r.w[i] << -n) | (prev >> (64 + n));
+    }
+    out.w[3] &= kLastWordMask;
+  } else {
+    out = r;
+  }
+  return out;
+}
+
+// `m ? a : b` per pixel
+inline Row Select(const Row &m, const Row &a, const Row &b) {
+  return (m & a) | (~m & b);
+}
+
+// Per pixel sum of four bits as three bit planes
+struct Sum {
+  Row b0, b1, b2;
+};
+
+inline Sum Sum4(const Row &a, const Row &b, const Row &c, const Row &d) {
+  auto p = a ^ b, q = a & b, r = c ^ d, t = c & d;
+  auto carry = p & r;
+  return {p ^ r, q ^ t ^ carry, (q & t) | (carry & (q ^ t))};
+}
+
+// Per pixel a < b
+inline Row Less(const Sum &a, const Sum &b) {
+  auto below0 = ~a.b0 & b.b0;
+  auto below1 = (~a.b1 & b.b1) | (~(a.b1 ^ b.b1) & below0);
+  return (~a.b2 & b.b2) | (~(a.b2 ^ b.b2) & below1);
+}
+
+// xBR corner of the pixels of row `e` towards `dx` horizontally and row
+// `h` vertically, `b` being the row on the other side and `h5` the one past
+// `h`. The corner takes the color of the edge when the weighted color
+// differences say the edge runs diagonally through it
+Row XbrCorner(const Row &e, const Row &h, const Row &b, const Row &h5,
+              int dx) {
+  auto f = Shift(e, dx), d = Shift(e, -dx);
+  auto i = Shift(h, dx), g = Shift(h, -dx), c = Shift(b, dx);
+  auto f4 = Shift(e, 2 * dx), i4 = Shift(h, 2 * dx), i5 = Shift(h5, dx);
+
+  // Both neighbors differ from e, so f == h and d(h, f) is 0
+  auto edge = (e ^ f) & (e ^ h);
+  auto wd1 = Sum4(e ^ c, e ^ g, i ^ f4, i ^ h5);
+  auto wd2 = Sum4(h ^ d, h ^ i5, f ^ i4, f ^ b);
+  // wd2 carries the 4 * d(e, i) term
+  auto ei = e ^ i;
+  auto full = wd1.b2 & ~(wd2.b2 | wd2.b1 | wd2.b0);
+  auto less = (ei & ~full) | (~ei & Less(wd1, wd2));
+
+  return e ^ (edge & less);
+}
+
+inline uint64_t Transpose8(uint64_t x) {
+  uint64_t t;
+  t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aa;
+  x = x ^ t ^ (t << 7);
+  t = (x ^ (x >> 14)) & 0x0000cccc0000cccc;
+  x = x ^ t ^ (t << 14);
+  t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0;
+  x = x ^ t ^ (t << 28);
+  return x;
+}
+
+// Turns the VRAM columns into upright rows, 8x8 pixel blocks at a time
+void LoadRows(const uint8_t *vram, Row *rows) {
+  memset(rows, 0, kScreenHeight * sizeof(Row));
+
+  for (uint32_t gx = 0; gx < kScreenWidth / 8; ++gx) {
+    auto word = gx / 8, shift = (gx % 8) * 8;
+
+    for (uint32_t y = 0; y < kVRAMLineSize; ++y) {
+      // Byte i holds column gx * 8 + i, bit b display row 255 - (y * 8 + b)
+      uint64_t block = 0;
+      for (int i = 0; i < 8; ++i) {
+        block |= (uint64_t)vram[(gx * 8 + i) * kVRAMLineSize + y] << (i * 8);
+      }
+      // Byte b now holds that display row, bit i column gx * 8 + i
+      block = Transpose8(block);
+
+      for (int b = 0; b < 8; ++b) {
+        rows[255 - (y * 8 + b)].w[word] |= ((block >> (b * 8)) & 0xff)
+                                           << shift;
+      }
+    }
+  }
+}
+} // namespace
+
+bool ParseScaleFilter(const std::string &name, ScaleFilter &filter) {
+  if (name == "scale2x") {
+    filter = SCALE_2X;
+  } else if (name == "scale3x") {
+    filter = SCALE_3X;
+  } else if (name == "xbr") {
+    filter = SCALE_XBR;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+int ScaleFactor(ScaleFilter filter) { return filter == SCALE_3X ? 3 : 2; }
+
+Upscaler::Upscaler(ScaleFilter filter, const Overlay &overlay)
+    : filter(filter), scale(ScaleFactor(filter)), overlay(overlay),
+      rows(kScreenHeight + 4), changed(kScreenHeight + 4),
+      rgb((size_t)Width() * Height() * 3) {}
+
+int Upscaler::Width() const { return kScreenWidth * scale; }
+int Upscaler::Height() const { return kScreenHeight * scale; }
+
+int Upscaler::Update(const uint8_t *vram) {
+  Row next[kScreenHeight];
+  LoadRows(vram, next);
+
+  for (int y = 0; y < kScreenHeight; ++y) {
+    changed[y + 2] = !valid || next[y] != rows[y + 2];
+    rows[y + 2] = next[y];
+  }
+  valid = true;
+
+  // Scale2x and Scale3x read one row up and down, xBR two
+  int reach = filter == SCALE_XBR ? 2 : 1;
+  int redone = 0;
+
+  for (int y = 0; y < kScreenHeight; ++y) {
+    bool dirty = false;
+    for (int n = -reach; n <= reach; ++n) {
+      dirty |= changed[y + 2 + n] != 0;
+    }
+
+    if (dirty) {
+      ScaleRow(y);
+      ++redone;
+    }
+  }
+
+  return redone;
+}
+
+void Upscaler::ScaleRow(int y) {
+  auto &e = rows[y + 2];
+  auto &b = rows[y + 1];
+  auto &h = rows[y + 3];
+
+  // Output pixel (x * scale + k, y * scale + j) is bit x of out[j][k]
+  Row out[3][3];
+
+  switch (filter) {
+  case SCALE_2X: {
+    auto d = Shift(e, -1), f = Shift(e, 1);
+    auto edge = (b ^ h) & (d ^ f);
+    out[0][0] = Select(edge & ~(d ^ b), d, e);
+    out[0][1] = Select(edge & ~(b ^ f), f, e);
+    out[1][0] = Select(edge & ~(d ^ h), d, e);
+    out[1][1] = Select(edge & ~(h ^ f), f, e);
+  } break;
+
+  case SCALE_3X: {
+    auto a = Shift(b, -1), c = Shift(b, 1);
+    auto d = Shift(e, -1), f = Shift(e, 1);
+    auto g = Shift(h, -1), i = Shift(h, 1);
+    auto edge = (b ^ h) & (d ^ f);
+
+    auto db = edge & ~(d ^ b), bf = edge & ~(b ^ f);
+    auto dh = edge & ~(d ^ h), hf = edge & ~(h ^ f);
+
+    out[0][0] = Select(db, d, e);
+    out[0][1] = Select((db & (e ^ c)) | (bf & (e ^ a)), b, e);
+    out[0][2] = Select(bf, f, e);
+    out[1][0] = Select((db & (e ^ g)) | (dh & (e ^ a)), d, e);
+    out[1][1] = e;
+    out[1][2] = Select((bf & (e ^ i)) | (hf & (e ^ c)), f, e);
+    out[2][0] = Select(dh, d, e);
+    out[2][1] = Select((dh & (e ^ i)) | (hf & (e ^ g)), h, e);
+    out[2][2] = Select(hf, f, e);
+  } break;
+
+  case SCALE_XBR: {
+    auto &b1 = rows[y];
+    auto &h5 = rows[y + 4];
+    out[0][0] = XbrCorner(e, b, h, b1, -1);
+    out[0][1] = XbrCorner(e, b, h, b1, 1);
+    out[1][0] = XbrCorner(e, h, b, h5, -1);
+    out[1][1] = XbrCorner(e, h, b, h5, 1);
+  } break;
+  }
+
+  auto color = overlay.rows[y];
+  const uint8_t colors[2][3] = {
+      {0, 0, 0},
+      {(uint8_t)(color >> 16), (uint8_t)(color >> 8), (uint8_t)color}};
+  auto stride = (size_t)Width() * 3;
+
+  for (int j = 0; j < scale; ++j) {
+    auto *dst = rgb.data() + (size_t)(y * scale + j) * stride;
+    for (int x = 0; x < kScreenWidth; ++x) {
+      for (int k = 0; k < scale; ++k) {
+        auto lit = (out[j][k].w[x >> 6] >> (x & 63)) & 1;
+        memcpy(dst, colors[lit], 3);
+        dst += 3;
+      }
+    }
+  }
+}
+} // namespace invaders
@@ -0,0 +1,69 @@
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "video.hpp"
+
+namespace invaders {
+#pragma once
+enum ScaleFilter {
+  // AdvMAME2x, rounds off diagonal edges without adding colors
+  SCALE_2X,
+  // AdvMAME3x
+  SCALE_3X,
+  // 2x xBR without blending, which looks further along edges than Scale2x
+  // before rounding a corner
+  SCALE_XBR,
+};
+
+// Parses "scale2x", "scale3x" or "xbr". Returns false on unknown names
+bool ParseScaleFilter(const std::string &name, ScaleFilter &filter);
+int ScaleFactor(ScaleFilter filter);
+
+// Upscales displayed frames (see Bus::DisplayFrame()) into RGB888 images with
+// the cabinet overlay, for recordings and previews without a GPU. The
+// filters run on whole 224 pixel rows at once as bitmasks, which works because
+// every source pixel is either lit or not. Only the rows near a changed source
+// row are redone, the rest of the image is kept from the previous frame
+class Upscaler {
+public:
+  // One upright source row, bit x of the words being pixel x. The bits past
+  // the right edge stay clear
+  struct Row {
+    uint64_t w[4];
+  };
+
+private:
+  ScaleFilter filter;
+  int scale;
+  Overlay overlay;
+
+  // Source rows with two clear rows of padding on either side
+  std::vector<Row> rows;
+  std::vector<uint8_t> changed;
+  bool valid = false;
+
+  std::vector<uint8_t> rgb;
+
+  void ScaleRow(int y);
+
+public:
+  explicit Upscaler(ScaleFilter filter,
+                    const Overlay &overlay = DefaultOverlay());
+
+  // Upscales a kVRAMSize byte VRAM image. Returns the number of source rows
+  // whose output was redone
+  int Update(const uint8_t *vram);
+  // Redoes the whole image on the next update
+  void Invalidate() { valid = false; }
+  void SetOverlay(const Overlay &overlay) {
+    this->overlay = overlay;
+    Invalidate();
+  }
+
+  const uint8_t *RGB() const { return rgb.data(); }
+  int Width() const;
+  int Height() const;
+  ScaleFilter Filter() const { return filter; }
+};
+} // namespace invaders
@@ -0,0 +1,134 @@
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+#include "bus.hpp"
+#include "vecenv.hpp"
+
+namespace invaders {
+VecEnv::VecEnv(size_t count, ObservationType obsType, int frameSkip,
+               bool maxPool, int frameStack)
+    : initial(std::make_unique<Bus>()), envs(count), obsType(obsType),
+      frameSkip(frameSkip < 1 ? 1 : frameSkip),
+      maxPool(maxPool && IsVRAMObservation(obsType)),
+      frameStack(frameStack < 1 ? 1 : frameStack) {
+  if (Buffered()) {
+    history.resize(count * ObservationSize());
+    heads.resize(count, 0);
+  }
+  if (this->maxPool) {
+    pooled.resize(kVRAMSize);
+  }
+
+  initial->Reset();
+  Reset();
+}
+
+bool VecEnv::LoadFileAt(const std::string path, const uint16_t start) {
+  if (!initial->LoadFileAt(path, start)) {
+    return false;
+  }
+
+  Reset();
+  return true;
+}
+
+bool VecEnv::LoadROM(const std::string &path) {
+  if (!initial->LoadROM(path)) {
+    return false;
+  }
+
+  Reset();
+  return true;
+}
+
+void VecEnv::SetDipSwitches(uint8_t dips) {
+  initial->SetDipSwitches(dips);
+  Reset();
+}
+
+void VecEnv::Reset() {
+  for (size_t i = 0; i < envs.size(); ++i) {
+    Reset(i);
+  }
+}
+
+void VecEnv::Reset(size_t index) {
+  envs[index] = initial->Clone();
+
+  if (Buffered()) {
+    // Nothing ran yet, so pooling would not change the first frame
+    WriteObservation(*envs[index], obsType, Frame(index, 0));
+    for (int slot = 1; slot < frameStack; ++slot) {
+      memcpy(Frame(index, slot), Frame(index, 0), FrameSize());
+    }
+    heads[index] = frameStack - 1;
+  }
+}
+
+void VecEnv::WriteFrame(size_t index, uint8_t *dst) {
+  auto &bus = *envs[index];
+  if (!maxPool) {
+    WriteObservation(bus, obsType, dst);
+    return;
+  }
+
+  // The maximum of 1bpp pixels is a bitwise or
+  uint8_t vram[kVRAMSize];
+  auto *frame = bus.DisplayFrame();
+  for (uint32_t i = 0; i < kVRAMSize; ++i) {
+    vram[i] = frame[i] | pooled[i];
+  }
+  VRAMToObservation(vram, obsType, dst);
+}
+
+void VecEnv::CopyStack(size_t index, uint8_t *dst) const {
+  auto frameSize = FrameSize();
+  auto *frames = history.data() + index * frameStack * frameSize;
+
+  // Oldest first, the slot after the newest one being the oldest
+  for (int i = 0; i < frameStack; ++i) {
+    auto slot = (heads[index] + 1 + i) % frameStack;
+    memcpy(dst + i * frameSize, frames + slot * frameSize, frameSize);
+  }
+}
+
+void VecEnv::Step(const uint16_t *actions, uint8_t *observations) {
+  auto size = ObservationSize();
+
+  for (size_t i = 0; i < envs.size(); ++i) {
+    auto &bus = *envs[i];
+
+    bus.SetInputs(actions[i]);
+    for (int frame = 0; frame < frameSkip; ++frame) {
+      if (maxPool && frame == frameSkip - 1) {
+        memcpy(pooled.data(), bus.DisplayFrame(), kVRAMSize);
+      }
+      bus.RunFrame();
+    }
+
+    if (!Buffered()) {
+      WriteObservation(bus, obsType, observations + i * size);
+      continue;
+    }
+
+    heads[i] = (heads[i] + 1) % frameStack;
+    WriteFrame(i, Frame(i, heads[i]));
+    CopyStack(i, observations + i * size);
+  }
+}
+
+void VecEnv::Observe(uint8_t *observations) const {
+  auto size = ObservationSize();
+
+  for (size_t i = 0; i < envs.size(); ++i) {
+    if (Buffered()) {
+      CopyStack(i, observations + i * size);
+    } else {
+      WriteObservation(*envs[i], obsType, observations + i * size);
+    }
+  }
+}
+} // namespace invaders
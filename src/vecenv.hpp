@@ -0,0 +1,77 @@
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "bus.hpp"
+#include "observation.hpp"
+
+namespace invaders {
+#pragma once
+// Steps a batch of emulators in lockstep and writes their observations
+// straight into a caller provided buffer. Steady state stepping does not
+// allocate or copy anything besides the observations themselves
+class VecEnv {
+  // Pristine machine with the ROM loaded. Resetting an environment clones it,
+  // so all environments share the ROM pages
+  std::unique_ptr<Bus> initial;
+  std::vector<std::unique_ptr<Bus>> envs;
+
+  ObservationType obsType;
+  int frameSkip;
+  bool maxPool;
+  int frameStack;
+
+  // With pooling or stacking, the last `frameStack` frames of each
+  // environment as a ring, `heads[i]` being the newest slot of environment i
+  std::vector<uint8_t> history;
+  std::vector<int> heads;
+  // VRAM before the last frame of a step, for pooling
+  std::vector<uint8_t> pooled;
+
+  bool Buffered() const { return maxPool || frameStack > 1; }
+  uint8_t *Frame(size_t index, int slot) {
+    return history.data() + (index * frameStack + slot) * FrameSize();
+  }
+  void WriteFrame(size_t index, uint8_t *dst);
+  void CopyStack(size_t index, uint8_t *dst) const;
+
+public:
+  // `maxPool` takes the pixel-wise maximum of the last two frames of a step,
+  // so sprites drawn on alternate frames are not lost. It applies to the VRAM
+  // based observation types only. `frameStack` concatenates the observations
+  // of that many steps, oldest first
+  VecEnv(size_t count, ObservationType obsType, int frameSkip = 4,
+         bool maxPool = false, int frameStack = 1);
+
+  bool LoadFileAt(const std::string path, const uint16_t start);
+  // Loads through the ROM cache, all environments share the ROM pages
+  bool LoadROM(const std::string &path);
+
+  // Applies to the pristine machine and resets all environments
+  void SetDipSwitches(uint8_t dips);
+
+  // Resets all or a single environment back to the power-on state
+  void Reset();
+  void Reset(size_t index);
+
+  // Applies `actions[i]` (a bitmask of KeyboardState values) to environment
+  // `i`, runs `frameSkip` frames and writes the observations into
+  // `observations`, which must hold Size() * ObservationSize() bytes
+  void Step(const uint16_t *actions, uint8_t *observations);
+  // Writes the observations without stepping
+  void Observe(uint8_t *observations) const;
+
+  size_t Size() const { return envs.size(); }
+  // Size of a single frame and of a stack of them
+  size_t FrameSize() const { return invaders::ObservationSize(obsType); }
+  size_t ObservationSize() const { return FrameSize() * frameStack; }
+  int FrameSkip() const { return frameSkip; }
+  bool MaxPool() const { return maxPool; }
+  int FrameStack() const { return frameStack; }
+
+  Bus &Env(size_t index) { return *envs[index]; }
+  const Bus &Env(size_t index) const { return *envs[index]; }
+};
+} // namespace invaders
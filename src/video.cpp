@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+#include "bus.hpp"
+#include "video.hpp"
+
+namespace invaders {
+const Overlay &DefaultOverlay() {
+  static const Overlay overlay = []() {
+    Overlay o;
+    for (int y = 0; y < kScreenHeight; ++y) {
+      o.rows[y] = 0xffffff;
+    }
+    for (int y = 32; y < 48; ++y) {
+      o.rows[y] = 0xff0000;
+    }
+    for (int y = 176; y < kScreenHeight; ++y) {
+      o.rows[y] = 0x00ff00;
+    }
+    return o;
+  }();
+  return overlay;
+}
+
+bool LoadOverlay(const std::string &path, Overlay &overlay) {
+  std::ifstream file(path);
+  if (!file) {
+    std::cerr << "Unable to open \"" << path << "\"" << std::endl;
+    return false;
+  }
+
+  for (int y = 0; y < kScreenHeight; ++y) {
+    overlay.rows[y] = 0xffffff;
+  }
+
+  std::string line;
+  for (int number = 1; std::getline(file, line); ++number) {
+    line = line.substr(0, line.find('#'));
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+      continue;
+    }
+
+    std::istringstream fields(line);
+    int first, last;
+    uint32_t color;
+    std::string rest;
+    if (!(fields >> first >> last >> std::hex >> color) || (fields >> rest) ||
+        first < 0 || last >= kScreenHeight || first > last ||
+        color > 0xffffff) {
+      std::cerr << path << ":" << number << ": expected \"<first row> "
+                << "<last row> <rrggbb>\" with rows in [0, "
+                << kScreenHeight - 1 << "]" << std::endl;
+      return false;
+    }
+
+    for (int y = first; y <= last; ++y) {
+      overlay.rows[y] = color;
+    }
+  }
+
+  return true;
+}
+
+void VRAMToRGB(const uint8_t *vram, uint8_t *rgb, const Overlay &overlay) {
+  for (unsigned int x = 0; x < kScreenWidth; ++x) {
+    auto *column = vram + x * kVRAMLineSize;
+    // The column starts with its bottom pixel
+    int row = kScreenHeight - 1;
+
+    for (unsigned int y = 0; y < kVRAMLineSize; ++y) {
+      auto byte = column[y];
+      for (unsigned int bit = 0; bit < 8; ++bit, --row) {
+        // All ones for lit pixels, selecting the overlay color
+        auto lit = 0u - ((byte >> bit) & 1);
+        auto c = overlay.rows[row] & lit;
+        auto *dst = rgb + (row * kScreenWidth + x) * 3;
+        dst[0] = c >> 16;
+        dst[1] = c >> 8;
+        dst[2] = c;
+      }
+    }
+  }
+}
+
+Phosphor::Phosphor(double persistence)
+    : levels(kScreenWidth * kScreenHeight, 0) {
+  SetPersistence(persistence);
+}
+
+void Phosphor::SetPersistence(double persistence) {
+  persistence = std::min(std::max(persistence, 0.0), 0.999);
+  decay = (uint32_t)(persistence * 0x10000);
+}
+
+void Phosphor::Reset() { std::fill(levels.begin(), levels.end(), 0); }
+
+void Phosphor::Apply(const uint8_t *vram, uint8_t *rgb,
+                     const Overlay &overlay) {
+  // Levels are kept in VRAM order so they are walked sequentially
+  auto *level = levels.data();
+
+  for (unsigned int x = 0; x < kScreenWidth; ++x) {
+    auto *column = vram + x * kVRAMLineSize;
+    int row = kScreenHeight - 1;
+
+    for (unsigned int y = 0; y < kVRAMLineSize; ++y) {
+      auto byte = column[y];
+      for (unsigned int bit = 0; bit < 8; ++bit, --row, ++level) {
+        // Lit pixels saturate to 0xffff, the rest decay
+        auto lit = 0u - ((byte >> bit) & 1);
+        uint32_t value = ((*level * decay) >> 16) | (lit & 0xffff);
+        *level = value;
+
+        // Scaling by value + 1 keeps fully lit pixels at the overlay color
+        auto c = overlay.rows[row];
+        auto scale = value + 1;
+        auto *dst = rgb + (row * kScreenWidth + x) * 3;
+        dst[0] = (((c >> 16) & 0xff) * scale) >> 16;
+        dst[1] = (((c >> 8) & 0xff) * scale) >> 16;
+        dst[2] = ((c & 0xff) * scale) >> 16;
+      }
+    }
+  }
+}
+
+void VRAMToPacked(const uint8_t *vram, uint8_t *packed) {
+  memset(packed, 0, kPackedFrameSize);
+
+  for (unsigned int x = 0; x < 224; ++x) {
+    uint8_t mask = 0x80 >> (x & 7);
+    for (unsigned int y = 0; y < 32; ++y) {
+      auto byte = vram[(x * 32) + y];
+      for (unsigned int bit = 0; bit < 8; ++bit) {
+        if (byte & (1 << bit)) {
+          packed[(255 - ((y * 8) + bit)) * kPackedRowBytes + x / 8] |= mask;
+        }
+      }
+    }
+  }
+}
+} // namespace invaders
@@ -0,0 +1,61 @@
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace invaders {
+#pragma once
+// Upright display size. The hardware scans the screen rotated, so VRAM holds
+// 224 columns of 256 pixels (32 bytes), bottom to top
+constexpr int kScreenWidth = 224;
+constexpr int kScreenHeight = 256;
+
+// Cabinet color overlay, the color of each upright display row as 0xrrggbb.
+// The gels are horizontal bands on the upright screen, which makes them
+// columns of VRAM
+struct Overlay {
+  uint32_t rows[kScreenHeight];
+};
+
+// Red band across the top and green across the bottom, as on the original
+// upright cabinet
+const Overlay &DefaultOverlay();
+
+// Reads an overlay from "<first row> <last row> <rrggbb>" lines, rows
+// counted from the top and inclusive. Later lines paint over earlier ones,
+// rows left out are white and '#' starts a comment. Returns false on
+// malformed files
+bool LoadOverlay(const std::string &path, Overlay &overlay);
+
+// Converts a 1bpp VRAM image into an upright RGB888 image of
+// kScreenWidth * kScreenHeight pixels, applying the cabinet color overlay
+void VRAMToRGB(const uint8_t *vram, uint8_t *rgb,
+               const Overlay &overlay = DefaultOverlay());
+
+// Exponential phosphor persistence. Lit pixels light up fully, unlit ones
+// keep `persistence` of their previous brightness each frame. Brightness is
+// tracked per pixel in 16 bit fixed point across calls
+class Phosphor {
+  std::vector<uint16_t> levels;
+  // Remaining brightness per frame, 0x10000 being all of it
+  uint32_t decay;
+
+public:
+  explicit Phosphor(double persistence = 0.5);
+
+  // Fraction of brightness left after a frame, in [0, 1)
+  void SetPersistence(double persistence);
+  // Turns every pixel off
+  void Reset();
+
+  // Like VRAMToRGB, adding the afterglow of earlier frames
+  void Apply(const uint8_t *vram, uint8_t *rgb,
+             const Overlay &overlay = DefaultOverlay());
+};
+
+// Upright 1bpp image, rows of kPackedRowBytes with the leftmost pixel in the
+// most significant bit and 1 for lit pixels (ffmpeg's monob)
+constexpr int kPackedRowBytes = kScreenWidth / 8;
+constexpr int kPackedFrameSize = kPackedRowBytes * kScreenHeight;
+
+void VRAMToPacked(const uint8_t *vram, uint8_t *packed);
+} // namespace invaders
@@ -0,0 +1,82 @@
+#include <iostream>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+#include "wav.hpp"
+
+namespace invaders {
+WavWriter::~WavWriter() { Close(); }
+
+bool WavWriter::Open(const std::string path, uint32_t sampleRate,
+                     uint16_t channels) {
+  Close();
+
+  file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "Unable to open WAV file \"" << path << "\"" << std::endl;
+    return false;
+  }
+
+  this->sampleRate = sampleRate;
+  this->channels = channels;
+  samples = 0;
+  WriteHeader();
+
+  return true;
+}
+
+void WavWriter::WriteHeader() {
+  uint32_t dataSize = samples * sizeof(int16_t);
+  uint8_t header[44];
+  size_t offset = 0;
+
+  auto put = [&header, &offset](uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+      header[offset++] = (value >> (i * 8)) & 0xff;
+    }
+  };
+
+  put(0x46464952, 4); // "RIFF"
+  put(36 + dataSize, 4);
+  put(0x45564157, 4); // "WAVE"
+  put(0x20746d66, 4); // "fmt "
+  put(16, 4);
+  put(1, 2); // PCM
+  put(channels, 2);
+  put(sampleRate, 4);
+  put(sampleRate * channels * sizeof(int16_t), 4);
+  put(channels * sizeof(int16_t), 2);
+  put(16, 2);
+  put(0x61746164, 4); // "data"
+  put(dataSize, 4);
+
+  fseek(file, 0, SEEK_SET);
+  fwrite(header, sizeof(header), 1, file);
+  fseek(file, 0, SEEK_END);
+}
+
+void WavWriter::Write(const int16_t *data, size_t count) {
+  if (file == nullptr) {
+    return;
+  }
+
+  // Samples are little-endian
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t bytes[2] = {(uint8_t)(data[i] & 0xff),
+                        (uint8_t)((uint16_t)data[i] >> 8)};
+    fwrite(bytes, sizeof(bytes), 1, file);
+  }
+  samples += count;
+}
+
+void WavWriter::Close() {
+  if (file == nullptr) {
+    return;
+  }
+
+  WriteHeader();
+  fclose(file);
+  file = nullptr;
+}
+} // namespace invaders
@@ -0,0 +1,28 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+namespace invaders {
+#pragma once
+// Writes 16-bit PCM WAV files. The header sizes are patched on Close()
+class WavWriter {
+  FILE *file = nullptr;
+  uint32_t sampleRate = 0;
+  uint16_t channels = 0;
+  uint64_t samples = 0;
+
+  void WriteHeader();
+
+public:
+  ~WavWriter();
+
+  bool Open(const std::string path, uint32_t sampleRate,
+            uint16_t channels = 1);
+  void Write(const int16_t *data, size_t count);
+  void Close();
+
+  bool IsOpen() const { return file != nullptr; }
+  uint64_t Samples() const { return samples; }
+};
+} // namespace invaders
@@ -0,0 +1,24 @@
+#include <iostream>
+
+namespace invaders {
+#pragma once
+// Assertions for the tests in this directory. A failed check is reported and
+// the test goes on, main() returns TestResult()
+inline int testFailures = 0;
+
+inline int TestResult() {
+  if (testFailures > 0) {
+    std::cerr << testFailures << " checks failed" << std::endl;
+  }
+  return testFailures == 0 ? 0 : 1;
+}
+} // namespace invaders
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition        \
+                << ") failed" << std::endl;                                    \
+      ++invaders::testFailures;                                                \
+    }                                                                          \
+  } while (0)
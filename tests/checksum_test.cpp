@@ -0,0 +1,63 @@
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "checksum.hpp"
+
+// Known answers from RFC 3174, the CRC catalogue and zlib
+
+namespace {
+const uint8_t *Bytes(const char *text) { return (const uint8_t *)text; }
+
+void TestCrc32() {
+  using invaders::Crc32;
+
+  CHECK(Crc32(Bytes(""), 0) == 0);
+  CHECK(Crc32(Bytes("123456789"), 9) == 0xcbf43926);
+
+  // In pieces
+  CHECK(Crc32(Bytes("6789"), 4, Crc32(Bytes("12345"), 5)) == 0xcbf43926);
+
+  std::vector<uint8_t> ones(100000, 0xff);
+  CHECK(Crc32(ones.data(), ones.size()) == 0x68c6cec4);
+}
+
+void TestAdler32() {
+  using invaders::Adler32;
+
+  CHECK(Adler32(Bytes(""), 0) == 1);
+  CHECK(Adler32(Bytes("Wikipedia"), 9) == 0x11e60398);
+  CHECK(Adler32(Bytes("pedia"), 5, Adler32(Bytes("Wiki"), 4)) == 0x11e60398);
+
+  // Long enough for the sums to need reducing many times over
+  std::vector<uint8_t> ones(100000, 0xff);
+  CHECK(Adler32(ones.data(), ones.size()) == 0x149a302c);
+}
+
+void TestSha1() {
+  using invaders::Sha1;
+
+  CHECK(Sha1(Bytes(""), 0) == "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+  CHECK(Sha1(Bytes("abc"), 3) == "a9993e364706816aba3e25717850c26c9cd0d89d");
+
+  // Two blocks, the padding does not fit in the first one
+  const char *twoBlocks =
+      "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  CHECK(Sha1(Bytes(twoBlocks), strlen(twoBlocks)) ==
+        "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+
+  std::string million(1000000, 'a');
+  CHECK(Sha1(Bytes(million.c_str()), million.size()) ==
+        "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+}
+} // namespace
+
+int main() {
+  TestCrc32();
+  TestAdler32();
+  TestSha1();
+
+  return invaders::TestResult();
+}
@@ -0,0 +1,339 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "bus.hpp"
+#include "check.hpp"
+#include "checksum.hpp"
+#include "png.hpp"
+#include "video.hpp"
+
+// Encodes images with EncodePNG and decodes them back with the minimal PNG
+// reader below, which handles what the encoder writes: palette and RGB
+// images, any filter, stored and fixed Huffman deflate blocks
+
+namespace {
+// Deflate reads bits starting from the least significant one
+class BitReader {
+  const std::vector<uint8_t> &data;
+  size_t pos = 0;
+
+public:
+  bool overrun = false;
+
+  explicit BitReader(const std::vector<uint8_t> &data, size_t start)
+      : data(data), pos(start * 8) {}
+
+  uint32_t Bits(int n) {
+    uint32_t value = 0;
+    for (int i = 0; i < n; ++i, ++pos) {
+      if (pos / 8 >= data.size()) {
+        overrun = true;
+        return 0;
+      }
+      value |= ((data[pos / 8] >> (pos % 8)) & 1) << i;
+    }
+    return value;
+  }
+
+  // Huffman codes start from their most significant bit
+  uint32_t Code(int n) {
+    uint32_t code = 0;
+    for (int i = 0; i < n; ++i) {
+      code = code << 1 | Bits(1);
+    }
+    return code;
+  }
+
+  void AlignToByte() { pos = (pos + 7) / 8 * 8; }
+  size_t BytePos() const { return pos / 8; }
+  void SeekByte(size_t at) { pos = at * 8; }
+};
+
+// Fixed literal/length code, RFC 1951 section 3.2.6
+int FixedSymbol(BitReader &bits) {
+  auto code = bits.Code(7);
+  if (code <= 0x17) {
+    return 256 + code;
+  }
+  code = code << 1 | bits.Code(1);
+  if (code >= 0x30 && code <= 0xbf) {
+    return code - 0x30;
+  }
+  if (code >= 0xc0 && code <= 0xc7) {
+    return 280 + code - 0xc0;
+  }
+  code = code << 1 | bits.Code(1);
+  return 144 + code - 0x190;
+}
+
+// Inflates a zlib stream. Returns false on anything unexpected
+bool Inflate(const std::vector<uint8_t> &zlib, std::vector<uint8_t> &out) {
+  static const uint16_t lengthBase[29] = {
+      3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+      31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+  static const uint16_t distanceBase[30] = {
+      1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+      33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+      1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+
+  if (zlib.size() < 6 || (zlib[0] & 0x0f) != 8 ||
+      (zlib[0] << 8 | zlib[1]) % 31 != 0) {
+    return false;
+  }
+
+  BitReader bits(zlib, 2);
+  bool last = false;
+
+  while (!last && !bits.overrun) {
+    last = bits.Bits(1);
+    auto type = bits.Bits(2);
+
+    if (type == 0) {
+      bits.AlignToByte();
+      auto at = bits.BytePos();
+      if (at + 4 > zlib.size()) {
+        return false;
+      }
+      size_t length = zlib[at] | zlib[at + 1] << 8;
+      if (at + 4 + length > zlib.size()) {
+        return false;
+      }
+      out.insert(out.end(), zlib.begin() + at + 4,
+                 zlib.begin() + at + 4 + length);
+      bits.SeekByte(at + 4 + length);
+      continue;
+    }
+    if (type != 1) {
+      return false;
+    }
+
+    while (!bits.overrun) {
+      auto symbol = FixedSymbol(bits);
+      if (symbol < 256) {
+        out.push_back(symbol);
+        continue;
+      }
+      if (symbol == 256) {
+        break;
+      }
+      if (symbol > 285) {
+        return false;
+      }
+
+      int l = symbol - 257;
+      // Lengths 11-257 and distances from 5 on carry extra bits
+      int lengthExtra = l >= 8 && l < 28 ? (l - 4) / 4 : 0;
+      size_t length = lengthBase[l] + bits.Bits(lengthExtra);
+
+      int d = bits.Code(5);
+      if (d >= 30) {
+        return false;
+      }
+      int distanceExtra = d >= 4 ? (d - 2) / 2 : 0;
+      size_t distance = distanceBase[d] + bits.Bits(distanceExtra);
+      if (distance > out.size()) {
+        return false;
+      }
+
+      for (size_t i = 0; i < length; ++i) {
+        out.push_back(out[out.size() - distance]);
+      }
+    }
+  }
+
+  bits.AlignToByte();
+  auto end = bits.BytePos();
+  if (bits.overrun || end + 4 > zlib.size()) {
+    return false;
+  }
+  uint32_t adler = 0;
+  for (int i = 0; i < 4; ++i) {
+    adler = adler << 8 | zlib[end + i];
+  }
+  return adler == invaders::Adler32(out.data(), out.size());
+}
+
+uint32_t Get32(const uint8_t *p) {
+  return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+struct Image {
+  int width = 0, height = 0;
+  int depth = 0, colorType = 0;
+  std::vector<uint8_t> rgb;
+};
+
+int Paeth(int a, int b, int c) {
+  int p = a + b - c;
+  int pa = p > a ? p - a : a - p;
+  int pb = p > b ? p - b : b - p;
+  int pc = p > c ? p - c : c - p;
+  return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+// Decodes the PNG into RGB888, checking every chunk CRC
+bool DecodePNG(const std::vector<uint8_t> &png, Image &image) {
+  static const uint8_t signature[8] = {0x89, 'P',  'N',  'G',
+                                       '\r', '\n', 0x1a, '\n'};
+  if (png.size() < 8 || memcmp(png.data(), signature, 8) != 0) {
+    return false;
+  }
+
+  std::vector<uint8_t> palette, zlib;
+  bool ended = false;
+
+  for (size_t at = 8; at < png.size() && !ended;) {
+    if (at + 12 > png.size()) {
+      return false;
+    }
+    size_t length = Get32(&png[at]);
+    if (at + 12 + length > png.size()) {
+      return false;
+    }
+    const uint8_t *type = &png[at + 4], *data = &png[at + 8];
+    if (Get32(data + length) != invaders::Crc32(type, length + 4)) {
+      return false;
+    }
+
+    if (memcmp(type, "IHDR", 4) == 0 && length == 13) {
+      image.width = Get32(data);
+      image.height = Get32(data + 4);
+      image.depth = data[8];
+      image.colorType = data[9];
+      // Deflate, adaptive filtering, no interlacing
+      if (data[10] != 0 || data[11] != 0 || data[12] != 0) {
+        return false;
+      }
+    } else if (memcmp(type, "PLTE", 4) == 0) {
+      palette.assign(data, data + length);
+    } else if (memcmp(type, "IDAT", 4) == 0) {
+      zlib.insert(zlib.end(), data, data + length);
+    } else if (memcmp(type, "IEND", 4) == 0) {
+      ended = true;
+    }
+
+    at += 12 + length;
+  }
+
+  bool indexed = image.colorType == 3;
+  if (!ended || image.width <= 0 || image.height <= 0 ||
+      !(indexed || (image.colorType == 2 && image.depth == 8))) {
+    return false;
+  }
+
+  std::vector<uint8_t> raw;
+  if (!Inflate(zlib, raw)) {
+    return false;
+  }
+
+  size_t rowBytes = indexed ? ((size_t)image.width * image.depth + 7) / 8
+                            : (size_t)image.width * 3;
+  size_t pixelBytes = indexed ? 1 : 3;
+  if (raw.size() != (rowBytes + 1) * image.height) {
+    return false;
+  }
+
+  std::vector<uint8_t> previous(rowBytes, 0), row(rowBytes);
+  image.rgb.clear();
+
+  for (int y = 0; y < image.height; ++y) {
+    auto *line = &raw[y * (rowBytes + 1)];
+    auto filter = line[0];
+
+    for (size_t i = 0; i < rowBytes; ++i) {
+      int a = i >= pixelBytes ? row[i - pixelBytes] : 0;
+      int b = previous[i];
+      int c = i >= pixelBytes ? previous[i - pixelBytes] : 0;
+      int predicted;
+      switch (filter) {
+      case 0: predicted = 0; break;
+      case 1: predicted = a; break;
+      case 2: predicted = b; break;
+      case 3: predicted = (a + b) / 2; break;
+      case 4: predicted = Paeth(a, b, c); break;
+      default: return false;
+      }
+      row[i] = line[1 + i] + predicted;
+    }
+
+    for (int x = 0; x < image.width; ++x) {
+      if (!indexed) {
+        image.rgb.insert(image.rgb.end(), &row[x * 3], &row[x * 3 + 3]);
+        continue;
+      }
+
+      auto bit = (size_t)x * image.depth;
+      size_t index = (row[bit / 8] >> (8 - image.depth - bit % 8)) &
+                   ((1 << image.depth) - 1);
+      if ((index + 1) * 3 > palette.size()) {
+        return false;
+      }
+      image.rgb.insert(image.rgb.end(), &palette[index * 3],
+                       &palette[index * 3 + 3]);
+    }
+
+    previous = row;
+  }
+
+  return true;
+}
+
+// Round trips `rgb` and checks the decoded pixels and the encoding chosen
+void RoundTrip(const std::vector<uint8_t> &rgb, int width, int height,
+               int depth, int colorType) {
+  Image image;
+  CHECK(DecodePNG(invaders::EncodePNG(rgb.data(), width, height), image));
+  CHECK(image.width == width && image.height == height);
+  CHECK(image.depth == depth && image.colorType == colorType);
+  CHECK(image.rgb == rgb);
+}
+
+// `colors` distinct colors scattered over the image
+std::vector<uint8_t> Pattern(int width, int height, int colors) {
+  std::vector<uint8_t> rgb;
+  for (int i = 0; i < width * height; ++i) {
+    auto color = (uint32_t)(i * 7) % colors;
+    rgb.push_back(color * 13);
+    rgb.push_back(color * 7);
+    rgb.push_back(255 - color);
+  }
+  return rgb;
+}
+
+void TestFrame() {
+  // A busy screen with every overlay color
+  std::vector<uint8_t> vram(invaders::kVRAMSize);
+  for (size_t i = 0; i < vram.size(); ++i) {
+    vram[i] = (uint8_t)(i * 0x9e3779b1 >> 24);
+  }
+
+  std::vector<uint8_t> rgb(invaders::kScreenWidth * invaders::kScreenHeight *
+                           3);
+  invaders::VRAMToRGB(vram.data(), rgb.data());
+  RoundTrip(rgb, invaders::kScreenWidth, invaders::kScreenHeight, 2, 3);
+}
+} // namespace
+
+int main() {
+  TestFrame();
+
+  // Palette depths, with widths that leave rows partly filled
+  RoundTrip(Pattern(1, 1, 1), 1, 1, 1, 3);
+  RoundTrip(Pattern(13, 7, 2), 13, 7, 1, 3);
+  RoundTrip(Pattern(5, 9, 4), 5, 9, 2, 3);
+  RoundTrip(Pattern(7, 5, 16), 7, 5, 4, 3);
+
+  // Too many colors for a palette
+  RoundTrip(Pattern(17, 9, 17), 17, 9, 8, 2);
+
+  // Long runs, matches up to the maximum length and distance
+  std::vector<uint8_t> runs(300 * 200 * 3);
+  for (size_t i = 0; i < runs.size(); ++i) {
+    runs[i] = (uint8_t)(i / 997 * 31 + i % 5);
+  }
+  RoundTrip(runs, 300, 200, 8, 2);
+
+  return invaders::TestResult();
+}
@@ -0,0 +1,134 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "bus.hpp"
+#include "check.hpp"
+#include "checksum.hpp"
+#include "rom.hpp"
+
+// Split sets assembled from generated files, which load unverified
+
+namespace fs = std::filesystem;
+
+namespace {
+const char *const kSetFiles[] = {"invaders.h", "invaders.g", "invaders.f",
+                                 "invaders.e"};
+constexpr size_t kFileSize = 0x800;
+
+void WriteFile(const fs::path &path, const std::vector<uint8_t> &data) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write((const char *)data.data(), data.size());
+}
+
+// Contents of the `index`th file of generation `seed`
+std::vector<uint8_t> SetFile(int index, int seed) {
+  std::vector<uint8_t> data(kFileSize);
+  for (size_t i = 0; i < kFileSize; ++i) {
+    data[i] = (uint8_t)(i * 7 + index * 0x40 + seed * 0x11 + (i >> 8));
+  }
+  return data;
+}
+
+// Writes a split set to `dir` and returns the image it should load as
+std::vector<uint8_t> WriteSet(const fs::path &dir, int seed) {
+  std::vector<uint8_t> image;
+  for (int i = 0; i < 4; ++i) {
+    auto data = SetFile(i, seed);
+    WriteFile(dir / kSetFiles[i], data);
+    image.insert(image.end(), data.begin(), data.end());
+  }
+  return image;
+}
+
+bool SameImage(const invaders::ROM &rom, const std::vector<uint8_t> &image) {
+  if (rom.Size() != image.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < image.size(); ++i) {
+    auto &page = rom.Page(i / invaders::kMemPageSize);
+    if (page->data[i % invaders::kMemPageSize] != image[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void TestSplitSet(const fs::path &dir) {
+  auto image = WriteSet(dir, 1);
+
+  auto rom = invaders::LoadROM(dir.string());
+  CHECK(rom != nullptr);
+  if (rom == nullptr) {
+    return;
+  }
+  CHECK(rom->Size() == 0x2000);
+  CHECK(SameImage(*rom, image));
+  CHECK(rom->Sha1() == invaders::Sha1(image.data(), image.size()));
+  // Generated files do not match the known set
+  CHECK(!rom->Verified());
+
+  // Unchanged files come from the cache
+  CHECK(invaders::LoadROM(dir.string()) == rom);
+
+  // The same image as a single file shares the pages
+  auto single = dir / "invaders.rom";
+  WriteFile(single, image);
+  CHECK(invaders::LoadROM(single.string()) == rom);
+
+  invaders::Bus bus;
+  bus.Reset();
+  CHECK(bus.LoadROM(dir.string()));
+  bool loaded = true;
+  for (uint32_t addr = 0; addr < image.size(); ++addr) {
+    loaded &= bus.Peek(addr) == image[addr];
+  }
+  CHECK(loaded);
+
+  // A changed file is read again. Its stamp is moved explicitly, file times
+  // can be too coarse to tell two quick writes apart
+  auto changed = SetFile(3, 2);
+  WriteFile(dir / kSetFiles[3], changed);
+  fs::last_write_time(dir / kSetFiles[3],
+                      fs::last_write_time(dir / kSetFiles[3]) +
+                          std::chrono::seconds(2));
+  memcpy(image.data() + 3 * kFileSize, changed.data(), kFileSize);
+
+  auto reloaded = invaders::LoadROM(dir.string());
+  CHECK(reloaded != nullptr && reloaded != rom);
+  CHECK(reloaded != nullptr && SameImage(*reloaded, image));
+}
+
+void TestBadSets(const fs::path &dir) {
+  WriteSet(dir, 3);
+
+  // Wrong size
+  WriteFile(dir / kSetFiles[1], std::vector<uint8_t>(kFileSize - 1));
+  CHECK(invaders::LoadROM(dir.string()) == nullptr);
+
+  // Missing file
+  fs::remove(dir / kSetFiles[1]);
+  CHECK(invaders::LoadROM(dir.string()) == nullptr);
+}
+} // namespace
+
+int main() {
+  auto root = fs::temp_directory_path() /
+              ("invaders-rom-test-" + std::to_string(
+                                          std::chrono::steady_clock::now()
+                                              .time_since_epoch()
+                                              .count()));
+
+  fs::create_directories(root / "set");
+  fs::create_directories(root / "bad");
+
+  TestSplitSet(root / "set");
+  TestBadSets(root / "bad");
+
+  fs::remove_all(root);
+  return invaders::TestResult();
+}
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "bus.hpp"
+#include "diagnostics.hpp"
+
+// Runs CP/M 8080 exerciser programs (cpudiag, 8080PRE, 8080EXM, ...) and
+// reports pass/fail and emulation speed for each
+
+namespace {
+// Top of the transient program area, as read by programs from 0x0006
+constexpr uint16_t kBDOSBase = 0xf000;
+
+// Echoes console output while keeping a copy for the pass/fail check
+class TeeBuffer : public std::streambuf {
+  std::streambuf *out;
+  std::string captured;
+
+protected:
+  int overflow(int ch) override {
+    if (ch != EOF) {
+      captured.push_back((char)ch);
+      if (out != nullptr) {
+        out->sputc((char)ch);
+      }
+    }
+    return ch;
+  }
+
+  int sync() override { return out != nullptr ? out->pubsync() : 0; }
+
+public:
+  explicit TeeBuffer(std::streambuf *out) : out(out) {}
+
+  const std::string &Captured() const { return captured; }
+};
+
+struct Result {
+  std::string name;
+  bool exited;
+  bool passed;
+  uint64_t instructions;
+  uint64_t cycles;
+  double seconds;
+};
+
+// Exercisers report failures with "ERROR" (8080PRE/EXM) or "FAILED"
+// (cpudiag)
+bool ReportsFailure(std::string output) {
+  std::transform(output.begin(), output.end(), output.begin(),
+                 [](unsigned char ch) { return std::toupper(ch); });
+  return output.find("ERROR") != std::string::npos ||
+         output.find("FAIL") != std::string::npos;
+}
+
+bool Run(const char *path, uint64_t maxInstructions, bool quiet,
+         Result &result) {
+  invaders::Bus bus;
+  bus.Reset();
+  bus.SetROMSize(0);
+
+  if (!bus.LoadFileAt(path, 0x0100)) {
+    return false;
+  }
+
+  // JMP to the BDOS at 0x0005, whose operand doubles as the top of memory.
+  // Calls are trapped by the CPU before the jump executes
+  bus.Poke(0x0005, 0xc3);
+  bus.Poke(0x0006, kBDOSBase & 0xff);
+  bus.Poke(0x0007, kBDOSBase >> 8);
+
+  // Returning from the program warm boots to 0x0000
+  auto regs = bus.cpu.GetRegisters();
+  regs.pc = 0x0100;
+  regs.sp = kBDOSBase - 2;
+  bus.Poke(regs.sp, 0x00);
+  bus.Poke(regs.sp + 1, 0x00);
+  bus.cpu.SetRegisters(regs);
+
+  TeeBuffer buffer(quiet ? nullptr : std::cout.rdbuf());
+  std::ostream console(&buffer);
+  bus.cpu.SetConsole(&console);
+  bus.SetDiagnostics(invaders::DIAG_CPM);
+
+  auto start = std::chrono::steady_clock::now();
+  while (!bus.cpu.CPMExited() && bus.cpu.Instructions() < maxInstructions) {
+    bus.cpu.Run(1'000'000);
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::string name = path;
+  auto slash = name.find_last_of("/\\");
+  if (slash != std::string::npos) {
+    name = name.substr(slash + 1);
+  }
+
+  result.name = name;
+  result.exited = bus.cpu.CPMExited();
+  result.passed = result.exited && !bus.cpu.CPMFailed() &&
+                  !ReportsFailure(buffer.Captured());
+  result.instructions = bus.cpu.Instructions();
+  result.cycles = bus.cpu.Cycles();
+  result.seconds = elapsed.count();
+
+  if (!quiet) {
+    std::cout << std::endl;
+  }
+
+  return true;
+}
+} // namespace
+
+int main(int argc, char **args) {
+  std::vector<const char *> programs;
+  uint64_t maxInstructions = 100'000'000'000;
+  bool quiet = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(args[i], "--max-instructions") == 0 && i + 1 < argc) {
+      maxInstructions = std::stoull(args[++i]);
+    } else if (strcmp(args[i], "--quiet") == 0) {
+      quiet = true;
+    } else {
+      programs.push_back(args[i]);
+    }
+  }
+
+  if (programs.empty()) {
+    std::cout << "Usage: " << args[0]
+              << " <program.com>... [--max-instructions N] [--quiet]"
+              << std::endl;
+    return 1;
+  }
+
+  std::vector<Result> results;
+  for (auto path : programs) {
+    Result result;
+    if (!Run(path, maxInstructions, quiet, result)) {
+      std::cerr << "Unable to load \"" << path << "\"" << std::endl;
+      return -1;
+    }
+    results.push_back(result);
+  }
+
+  bool allPassed = true;
+
+  std::cout << "Program           Result    Instructions     MIPS    MHz"
+            << std::endl;
+  for (auto &r : results) {
+    allPassed &= r.passed;
+
+    std::cout << std::left << std::setw(18) << r.name << std::setw(8)
+              << (r.passed ? "PASS" : r.exited ? "FAIL" : "TIMEOUT")
+              << std::right << std::setw(16) << r.instructions << std::fixed
+              << std::setprecision(2) << std::setw(9)
+              << r.instructions / r.seconds / 1e6 << std::setw(7)
+              << r.cycles / r.seconds / 1e6 << std::endl;
+  }
+
+  return allPassed ? 0 : 1;
+}
@@ -0,0 +1,421 @@
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "audio.hpp"
+#include "bus.hpp"
+#include "capture.hpp"
+#include "diagnostics.hpp"
+#include "framesink.hpp"
+#include "memstats.hpp"
+#include "metrics.hpp"
+#include "options.hpp"
+#include "perfcounters.hpp"
+#include "profiler.hpp"
+#include "tracer.hpp"
+#include "upscale.hpp"
+#include "video.hpp"
+
+static void PrintUsage(const char *program) {
+  std::cout << "Usage: " << program
+              << " <rom> [--frames N] [--hash-log FILE] [--trace FILE]"
+                 " [--profile FILE] [--mem-stats PREFIX]"
+                 " [--metrics-dump FILE|-] [--metrics-interval SECONDS]"
+                 " [--perf] [--wav FILE] [--record-inputs FILE]"
+                 " [--replay-inputs FILE] [--dip-switches HEX]"
+                 " [--video FILE|-] [--video-format y4m|1bpp]"
+                 " [--png DIR] [--png-range FIRST:LAST] [--png-threads N]"
+                 " [--png-scale scale2x|scale3x|xbr] [--overlay FILE]"
+                 " [--phosphor PERSISTENCE]"
+                 " [--log-interrupts] [--log-mem-writes]"
+              << std::endl;
+}
+
+// Parses FIRST:LAST, or FIRST for a single frame
+static bool ParseFrameRange(const char *text, uint64_t &first,
+                            uint64_t &last) {
+  std::string range = text;
+  auto colon = range.find(':');
+  if (!invaders::ParseNumber(range.substr(0, colon).c_str(), 10, 0,
+                             UINT64_MAX, first)) {
+    return false;
+  }
+  if (colon == std::string::npos) {
+    last = first;
+    return true;
+  }
+  return invaders::ParseNumber(range.c_str() + colon + 1, 10, first,
+                               UINT64_MAX, last);
+}
+
+// Runs the emulator without any frontend. Mostly useful for diffing state
+// hashes across builds and interpreter changes
+int main(int argc, char **args) {
+  if (argc < 2) {
+    PrintUsage(args[0]);
+    return 1;
+  }
+
+  const char *romPath = nullptr;
+  const char *hashLogPath = nullptr;
+  const char *tracePath = nullptr;
+  const char *profilePath = nullptr;
+  const char *memStatsPrefix = nullptr;
+  const char *metricsPath = nullptr;
+  double metricsInterval = 10;
+  bool perf = false;
+  const char *wavPath = nullptr;
+  const char *recordPath = nullptr;
+  const char *replayPath = nullptr;
+  uint8_t dipSwitches = 0;
+  const char *videoPath = nullptr;
+  auto videoFormat = invaders::FRAME_Y4M;
+  const char *pngDir = nullptr;
+  uint64_t pngFirst = 1;
+  uint64_t pngLast = UINT64_MAX;
+  int pngThreads = 0;
+  bool pngScaled = false;
+  auto pngFilter = invaders::SCALE_2X;
+  auto overlay = invaders::DefaultOverlay();
+  double phosphor = 0;
+  uint64_t frames = 600;
+  uint32_t diagnostics = invaders::DIAG_NONE;
+
+  // Reads the value of the numeric option at args[i]
+  auto number = [&](int &i, int base, uint64_t min, uint64_t max,
+                    uint64_t &value) {
+    auto *option = args[i++];
+    if (invaders::ParseNumberOption(option, args[i], base, min, max, value)) {
+      return true;
+    }
+    PrintUsage(args[0]);
+    return false;
+  };
+  uint64_t value;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(args[i], "--frames") == 0 && i + 1 < argc) {
+      if (!number(i, 10, 0, UINT64_MAX, value)) {
+        return 1;
+      }
+      frames = value;
+    } else if (strcmp(args[i], "--hash-log") == 0 && i + 1 < argc) {
+      hashLogPath = args[++i];
+    } else if (strcmp(args[i], "--trace") == 0 && i + 1 < argc) {
+      tracePath = args[++i];
+      diagnostics |= invaders::DIAG_TRACE_CPU;
+    } else if (strcmp(args[i], "--profile") == 0 && i + 1 < argc) {
+      profilePath = args[++i];
+      diagnostics |= invaders::DIAG_PROFILE;
+    } else if (strcmp(args[i], "--mem-stats") == 0 && i + 1 < argc) {
+      memStatsPrefix = args[++i];
+      diagnostics |= invaders::DIAG_MEM_STATS;
+    } else if (strcmp(args[i], "--metrics-dump") == 0 && i + 1 < argc) {
+      metricsPath = args[++i];
+    } else if (strcmp(args[i], "--metrics-interval") == 0 && i + 1 < argc) {
+      metricsInterval = std::stod(args[++i]);
+    } else if (strcmp(args[i], "--perf") == 0) {
+      perf = true;
+    } else if (strcmp(args[i], "--wav") == 0 && i + 1 < argc) {
+      wavPath = args[++i];
+    } else if (strcmp(args[i], "--record-inputs") == 0 && i + 1 < argc) {
+      recordPath = args[++i];
+    } else if (strcmp(args[i], "--replay-inputs") == 0 && i + 1 < argc) {
+      replayPath = args[++i];
+    } else if (strcmp(args[i], "--dip-switches") == 0 && i + 1 < argc) {
+      if (!number(i, 16, 0, 0xff, value)) {
+        return 1;
+      }
+      dipSwitches = value;
+    } else if (strcmp(args[i], "--video") == 0 && i + 1 < argc) {
+      videoPath = args[++i];
+    } else if (strcmp(args[i], "--png") == 0 && i + 1 < argc) {
+      pngDir = args[++i];
+    } else if (strcmp(args[i], "--png-range") == 0 && i + 1 < argc) {
+      // Frame numbers as counted by the hash log, inclusive
+      if (!ParseFrameRange(args[++i], pngFirst, pngLast)) {
+        std::cerr << "Invalid frame range \"" << args[i]
+                  << "\" for --png-range, expected FIRST:LAST with FIRST <= "
+                     "LAST"
+                  << std::endl;
+        PrintUsage(args[0]);
+        return 1;
+      }
+    } else if (strcmp(args[i], "--png-threads") == 0 && i + 1 < argc) {
+      // 0 for one per core
+      if (!number(i, 10, 0, 1024, value)) {
+        return 1;
+      }
+      pngThreads = value;
+    } else if (strcmp(args[i], "--png-scale") == 0 && i + 1 < argc) {
+      if (!invaders::ParseScaleFilter(args[++i], pngFilter)) {
+        std::cerr << "Unknown scale filter \"" << args[i] << "\""
+                  << std::endl;
+        return 1;
+      }
+      pngScaled = true;
+    } else if (strcmp(args[i], "--overlay") == 0 && i + 1 < argc) {
+      if (!invaders::LoadOverlay(args[++i], overlay)) {
+        return 1;
+      }
+    } else if (strcmp(args[i], "--phosphor") == 0 && i + 1 < argc) {
+      phosphor = std::stod(args[++i]);
+    } else if (strcmp(args[i], "--video-format") == 0 && i + 1 < argc) {
+      if (!invaders::ParseFrameFormat(args[++i], videoFormat)) {
+        std::cerr << "Unknown video format \"" << args[i] << "\""
+                  << std::endl;
+        return 1;
+      }
+    } else if (invaders::ParseDiagnosticsFlag(args[i], diagnostics)) {
+      continue;
+    } else {
+      romPath = args[i];
+    }
+  }
+
+  if (romPath == nullptr) {
+    std::cerr << "No invaders ROM file specified. Aborting..." << std::endl;
+    return 1;
+  }
+
+  invaders::Bus bus;
+  bus.Reset();
+  bus.SetDipSwitches(dipSwitches);
+
+  if (!bus.LoadROM(romPath)) {
+    std::cerr << "Unable to start the emulator" << std::endl;
+    return -1;
+  }
+
+  std::ofstream hashLog;
+  if (hashLogPath != nullptr) {
+    // "-" logs to stdout
+    if (strcmp(hashLogPath, "-") == 0) {
+      bus.SetHashLog(&std::cout);
+    } else {
+      hashLog.open(hashLogPath);
+      if (!hashLog) {
+        std::cerr << "Unable to open \"" << hashLogPath << "\"" << std::endl;
+        return -1;
+      }
+      bus.SetHashLog(&hashLog);
+    }
+  }
+
+  // Replayed inputs land on the same cycles they were recorded at
+  if (replayPath != nullptr) {
+    std::ifstream replay(replayPath);
+    if (!replay) {
+      std::cerr << "Unable to open \"" << replayPath << "\"" << std::endl;
+      return -1;
+    }
+    if (!bus.LoadInputLog(replay)) {
+      return -1;
+    }
+  }
+
+  std::ofstream inputLog;
+  if (recordPath != nullptr) {
+    inputLog.open(recordPath);
+    if (!inputLog) {
+      std::cerr << "Unable to open \"" << recordPath << "\"" << std::endl;
+      return -1;
+    }
+    bus.SetInputLog(&inputLog);
+  }
+
+  invaders::Tracer tracer;
+  if (tracePath != nullptr) {
+    if (!tracer.Start(tracePath)) {
+      return -1;
+    }
+    bus.cpu.SetTracer(&tracer);
+  }
+
+  invaders::Profiler profiler;
+  std::ofstream folded;
+  if (profilePath != nullptr) {
+    folded.open(profilePath);
+    if (!folded) {
+      std::cerr << "Unable to open \"" << profilePath << "\"" << std::endl;
+      return -1;
+    }
+    bus.cpu.SetProfiler(&profiler);
+  }
+
+  std::unique_ptr<invaders::MemoryStats> memStats;
+  if (memStatsPrefix != nullptr) {
+    memStats = std::make_unique<invaders::MemoryStats>();
+    bus.SetMemoryStats(memStats.get());
+  }
+
+  invaders::Metrics metrics;
+  std::ofstream metricsDump;
+  std::ostream *metricsOut = nullptr;
+  if (metricsPath != nullptr) {
+    if (strcmp(metricsPath, "-") == 0) {
+      metricsOut = &std::cout;
+    } else {
+      metricsDump.open(metricsPath, std::ios::app);
+      if (!metricsDump) {
+        std::cerr << "Unable to open \"" << metricsPath << "\"" << std::endl;
+        return -1;
+      }
+      metricsOut = &metricsDump;
+    }
+    metrics.SetDump(metricsOut, metricsInterval);
+  }
+
+  invaders::PerfCounters perfCounters;
+  if (perf && !perfCounters.Open()) {
+    return -1;
+  }
+
+  // Sound is rendered at the emulated pace straight into the WAV file. The
+  // event ring is sized so the mixer can fall behind a fast run
+  invaders::Audio audio(1 << 16);
+  invaders::WavWriter wav;
+  if (wavPath != nullptr) {
+    if (!wav.Open(wavPath, invaders::Audio::kSampleRate)) {
+      return -1;
+    }
+    audio.Start(false, &wav);
+    bus.SetAudio(&audio);
+  }
+
+  // Headless runs are not real time, so wait for the writer instead of
+  // dropping frames and keep the recording complete
+  invaders::FrameSink video;
+  video.SetOverlay(overlay);
+  if (videoPath != nullptr && !video.Open(videoPath, videoFormat)) {
+    return -1;
+  }
+
+  // Frames are compressed on the worker threads
+  std::unique_ptr<invaders::FrameCapture> capture;
+  if (pngDir != nullptr) {
+    capture = std::make_unique<invaders::FrameCapture>(pngThreads);
+  }
+  std::vector<uint8_t> rgb(invaders::kScreenWidth * invaders::kScreenHeight *
+                           3);
+  std::unique_ptr<invaders::Upscaler> upscaler;
+  if (pngScaled) {
+    upscaler = std::make_unique<invaders::Upscaler>(pngFilter, overlay);
+  }
+  invaders::Phosphor phosphorEffect(phosphor);
+
+  bus.SetDiagnostics(diagnostics);
+
+  for (uint64_t i = 0; i < frames; i++) {
+    metrics.Begin(invaders::Metrics::SECTION_EMULATION);
+    if (perf) {
+      perfCounters.Start();
+      bus.RunFrame();
+      perfCounters.Stop();
+    } else {
+      bus.RunFrame();
+    }
+    metrics.End(invaders::Metrics::SECTION_EMULATION);
+    metrics.EndFrame(1, 0, bus.cpu.Instructions(), bus.cpu.Cycles());
+
+    if (video.IsOpen()) {
+      video.Submit(bus.DisplayFrame(), true);
+    }
+
+    // The afterglow builds up over every frame, not only the captured ones.
+    // It applies to unscaled PNGs
+    if (capture && !upscaler && phosphor > 0) {
+      phosphorEffect.Apply(bus.DisplayFrame(), rgb.data(), overlay);
+    }
+
+    auto frame = bus.FrameCount();
+    if (capture && frame >= pngFirst && frame <= pngLast) {
+      auto path = invaders::FrameCapture::FramePath(pngDir, "frame", frame);
+      if (upscaler) {
+        upscaler->Update(bus.DisplayFrame());
+        capture->Submit(path, upscaler->RGB(), upscaler->Width(),
+                        upscaler->Height(), true);
+      } else {
+        // With the afterglow, `rgb` already holds the frame
+        if (phosphor <= 0) {
+          invaders::VRAMToRGB(bus.DisplayFrame(), rgb.data(), overlay);
+        }
+        capture->Submit(path, rgb.data(), invaders::kScreenWidth,
+                        invaders::kScreenHeight, true);
+      }
+    }
+  }
+
+  video.Close();
+  if (capture) {
+    capture->Wait();
+  }
+
+  // Keep stdout clean when the video goes there
+  auto &report =
+      videoPath != nullptr && strcmp(videoPath, "-") == 0 ? std::cerr
+                                                          : std::cout;
+
+  // Always emit a final sample so short runs still produce one
+  if (metricsOut != nullptr) {
+    metrics.WriteJSON(*metricsOut);
+  }
+
+  bus.cpu.SetTracer(nullptr);
+  tracer.Stop();
+
+  if (wavPath != nullptr) {
+    bus.SetAudio(nullptr);
+    audio.Stop();
+    wav.Close();
+
+    if (audio.DroppedEvents() > 0) {
+      std::cerr << "Audio dropped " << audio.DroppedEvents() << " events"
+                << std::endl;
+    }
+  }
+
+  if (memStats) {
+    std::ofstream memCSV(std::string(memStatsPrefix) + "-mem.csv");
+    memStats->WriteMemoryCSV(memCSV);
+    std::ofstream ioCSV(std::string(memStatsPrefix) + "-io.csv");
+    memStats->WriteIOCSV(ioCSV);
+  }
+
+  if (profilePath != nullptr) {
+    profiler.WriteFolded(folded);
+    folded.close();
+  }
+
+  // Nothing ran, e.g. with --frames 0
+  if (profilePath != nullptr && profiler.TotalCycles() > 0) {
+    auto total = profiler.TotalCycles();
+    auto routines = profiler.Routines();
+
+    report << "Routine   Calls        Self%   Total%" << std::endl;
+    for (size_t i = 0; i < routines.size() && i < 20; ++i) {
+      auto &r = routines[i];
+      report << (r.interrupt ? "int_" : "sub_") << std::hex
+             << std::setfill('0') << std::setw(4) << r.address << "  "
+             << std::dec << std::setfill(' ') << std::setw(11) << r.calls
+             << std::fixed << std::setprecision(2) << std::setw(8)
+             << 100.0 * r.selfCycles / total << std::setw(9)
+             << 100.0 * r.totalCycles / total << std::endl;
+    }
+  }
+
+  if (perf) {
+    perfCounters.WriteReport(report, bus.cpu.Instructions());
+  }
+
+  report << "Frames: " << std::dec << bus.FrameCount() << std::endl
+         << "Hash: " << std::hex << std::setfill('0') << std::setw(16)
+         << bus.FrameHash() << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,78 @@
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <stdint.h>
+#include <string>
+
+#include "bus.hpp"
+#include "cpu.hpp"
+#include "lockstep.hpp"
+
+// Runs a ROM on the reference and the fast CPU engine side by side with the
+// same pseudo random inputs, and stops at the first divergence
+int main(int argc, char **args) {
+  if (argc < 2) {
+    std::cout << "Usage: " << args[0]
+              << " <rom> [--frames N] [--interval CYCLES] [--seed N]"
+              << std::endl;
+    return 1;
+  }
+
+  const char *romPath = nullptr;
+  uint64_t frames = 600;
+  uint32_t interval = 1;
+  uint32_t seed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(args[i], "--frames") == 0 && i + 1 < argc) {
+      frames = std::stoull(args[++i]);
+    } else if (strcmp(args[i], "--interval") == 0 && i + 1 < argc) {
+      interval = std::stoul(args[++i]);
+    } else if (strcmp(args[i], "--seed") == 0 && i + 1 < argc) {
+      seed = std::stoul(args[++i]);
+    } else {
+      romPath = args[i];
+    }
+  }
+
+  invaders::Bus reference;
+  invaders::Bus candidate;
+  reference.cpu.SetEngine(invaders::ENGINE_REFERENCE);
+  candidate.cpu.SetEngine(invaders::ENGINE_FAST);
+
+  for (auto *bus : {&reference, &candidate}) {
+    bus->Reset();
+    if (romPath == nullptr || !bus->LoadROM(romPath)) {
+      std::cerr << "Unable to load the ROM" << std::endl;
+      return -1;
+    }
+  }
+
+  invaders::Lockstep lockstep(reference, candidate);
+
+  const uint16_t buttons =
+      invaders::COIN | invaders::P1_START | invaders::P1_FIRE |
+      invaders::P1_LEFT | invaders::P1_RIGHT | invaders::P2_START |
+      invaders::P2_FIRE | invaders::P2_LEFT | invaders::P2_RIGHT;
+
+  for (uint64_t frame = 0; frame < frames; ++frame) {
+    // Same inputs on both sides, changing every 8 frames
+    if (frame % 8 == 0) {
+      seed = seed * 1664525 + 1013904223;
+      auto inputs = (seed >> 16) & buttons;
+      reference.SetInputs(inputs);
+      candidate.SetInputs(inputs);
+    }
+
+    if (!lockstep.Run(invaders::Bus::kFrameCycles, interval, std::cerr)) {
+      return 1;
+    }
+  }
+
+  std::cout << "Frames: " << frames << std::endl
+            << "Comparisons: " << lockstep.Comparisons() << std::endl
+            << "Hash: " << std::hex << std::setfill('0') << std::setw(16)
+            << reference.FrameHash() << std::endl;
+
+  return 0;
+}
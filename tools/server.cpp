@@ -0,0 +1,246 @@
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <new>
+#include <stdint.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "observation.hpp"
+#include "options.hpp"
+#include "shm_protocol.hpp"
+#include "vecenv.hpp"
+
+static volatile std::sig_atomic_t stopRequested = 0;
+
+// Unlinks `name` if it is still the segment with inode `inode`. After a
+// --force restart the name belongs to the newer server
+static void UnlinkOwn(const std::string &name, ino_t inode) {
+  auto fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  bool own = fstat(fd, &st) == 0 && st.st_ino == inode;
+  close(fd);
+  if (own) {
+    shm_unlink(name.c_str());
+  }
+}
+
+static void HandleSignal(int) { stopRequested = 1; }
+
+static void PrintUsage(const char *program) {
+  std::cout << "Usage: " << program
+            << " <rom> [--name /invaders] [--force] [--envs N]"
+               " [--obs vram|gray|ram|gray84|bits84] [--frame-skip N]"
+               " [--max-pool] [--frame-stack N] [--dip-switches HEX]"
+            << std::endl;
+}
+
+// Hosts a batch of emulators behind a POSIX shared memory segment. See
+// shm_protocol.hpp for the layout and the step handshake
+int main(int argc, char **args) {
+  if (argc < 2) {
+    PrintUsage(args[0]);
+    return 1;
+  }
+
+  const char *romPath = nullptr;
+  std::string name = "/invaders";
+  bool force = false;
+  uint32_t envCount = 16;
+  int frameSkip = 4;
+  bool maxPool = false;
+  int frameStack = 1;
+  uint8_t dipSwitches = 0;
+  auto obsType = invaders::OBS_VRAM_1BPP;
+
+  // Reads the value of the numeric option at args[i]
+  auto number = [&](int &i, int base, uint64_t min, uint64_t max,
+                    uint64_t &value) {
+    auto *option = args[i++];
+    if (invaders::ParseNumberOption(option, args[i], base, min, max, value)) {
+      return true;
+    }
+    PrintUsage(args[0]);
+    return false;
+  };
+  uint64_t value;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(args[i], "--name") == 0 && i + 1 < argc) {
+      name = args[++i];
+    } else if (strcmp(args[i], "--force") == 0) {
+      force = true;
+    } else if (strcmp(args[i], "--envs") == 0 && i + 1 < argc) {
+      // At least one environment
+      if (!number(i, 10, 1, UINT32_MAX, value)) {
+        return 1;
+      }
+      envCount = value;
+    } else if (strcmp(args[i], "--frame-skip") == 0 && i + 1 < argc) {
+      if (!number(i, 10, 1, INT_MAX, value)) {
+        return 1;
+      }
+      frameSkip = value;
+    } else if (strcmp(args[i], "--max-pool") == 0) {
+      maxPool = true;
+    } else if (strcmp(args[i], "--frame-stack") == 0 && i + 1 < argc) {
+      if (!number(i, 10, 1, INT_MAX, value)) {
+        return 1;
+      }
+      frameStack = value;
+    } else if (strcmp(args[i], "--dip-switches") == 0 && i + 1 < argc) {
+      if (!number(i, 16, 0, 0xff, value)) {
+        return 1;
+      }
+      dipSwitches = value;
+    } else if (strcmp(args[i], "--obs") == 0 && i + 1 < argc) {
+      if (!invaders::ParseObservationType(args[++i], obsType)) {
+        std::cerr << "Unknown observation type \"" << args[i] << "\""
+                  << std::endl;
+        return 1;
+      }
+    } else {
+      romPath = args[i];
+    }
+  }
+
+  if (romPath == nullptr) {
+    std::cerr << "No invaders ROM file specified. Aborting..." << std::endl;
+    return 1;
+  }
+
+  invaders::VecEnv env(envCount, obsType, frameSkip, maxPool, frameStack);
+  env.SetDipSwitches(dipSwitches);
+  if (!env.LoadROM(romPath)) {
+    std::cerr << "Unable to start the emulator" << std::endl;
+    return -1;
+  }
+
+  auto obsSize = (uint32_t)env.ObservationSize();
+  auto segmentSize = invaders::ShmSegmentSize(envCount, obsSize);
+
+  // Never reuse an existing segment, another server may still have it mapped
+  // and would fault once it shrinks. --force unlinks it instead, which leaves
+  // the old mapping intact for whoever holds it
+  if (force) {
+    shm_unlink(name.c_str());
+  }
+  auto fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0 && errno == EEXIST) {
+    std::cerr << "Shared memory \"" << name
+              << "\" already exists, another server may be using it. Pick "
+                 "another --name, or pass --force to replace it"
+              << std::endl;
+    return -1;
+  }
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 || ftruncate(fd, segmentSize) != 0) {
+    std::cerr << "Unable to create shared memory \"" << name
+              << "\": " << strerror(errno) << std::endl;
+    if (fd >= 0) {
+      close(fd);
+      shm_unlink(name.c_str());
+    }
+    return -1;
+  }
+  auto inode = st.st_ino;
+
+  auto *base = (uint8_t *)mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE,
+                               MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    std::cerr << "Unable to map shared memory: " << strerror(errno)
+              << std::endl;
+    shm_unlink(name.c_str());
+    return -1;
+  }
+
+  auto *header = new (base) invaders::ShmHeader();
+  header->envCount = envCount;
+  header->obsType = obsType;
+  header->obsSize = obsSize;
+  header->frameSkip = env.FrameSkip();
+  header->maxPool = env.MaxPool();
+  header->frameStack = env.FrameStack();
+  header->dipSwitches = dipSwitches;
+  header->actionsOffset = invaders::ShmAlign(sizeof(invaders::ShmHeader));
+  header->resetsOffset =
+      header->actionsOffset + invaders::ShmAlign(envCount * sizeof(uint16_t));
+  header->observationsOffset =
+      header->resetsOffset + invaders::ShmAlign(envCount);
+  header->totalSize = segmentSize;
+  header->version = invaders::kShmVersion;
+
+  auto *actions = (uint16_t *)(base + header->actionsOffset);
+  auto *resets = base + header->resetsOffset;
+  auto *observations = base + header->observationsOffset;
+
+  env.Observe(observations);
+
+  // Publishing the magic last tells clients the segment is ready
+  header->magic.store(invaders::kShmMagic, std::memory_order_release);
+
+  std::signal(SIGINT, HandleSignal);
+  std::signal(SIGTERM, HandleSignal);
+
+  std::cout << "Serving " << envCount << " environments on \"" << name
+            << "\" (" << segmentSize << " bytes)" << std::endl;
+
+  uint32_t seen = header->request.load(std::memory_order_acquire);
+
+  while (!stopRequested) {
+    // Time out regularly to notice signals
+    auto request = invaders::ShmWait(header->request, seen, 100);
+    if (request == seen) {
+      continue;
+    }
+    seen = request;
+
+    auto command = header->command.load(std::memory_order_relaxed);
+    if (command == invaders::SHM_SHUTDOWN) {
+      break;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t i = 0; i < envCount; ++i) {
+      if (resets[i] != 0) {
+        env.Reset(i);
+        resets[i] = 0;
+      }
+    }
+
+    if (command == invaders::SHM_STEP) {
+      env.Step(actions, observations);
+    } else {
+      env.Observe(observations);
+    }
+
+    header->lastStepNanos =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count();
+
+    header->response.store(request, std::memory_order_release);
+    invaders::ShmWake(header->response);
+  }
+
+  // Unblock a client waiting on a step that will never be answered
+  header->magic.store(0, std::memory_order_release);
+  header->response.store(seen + 1, std::memory_order_release);
+  invaders::ShmWake(header->response);
+
+  munmap(base, segmentSize);
+  UnlinkOwn(name, inode);
+
+  return 0;
+}
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "bus.hpp"
+#include "observation.hpp"
+#include "shm_protocol.hpp"
+#include "vecenv.hpp"
+
+static uint64_t NowNanos() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1'000'000'000 + ts.tv_nsec;
+}
+
+// Test harness for invaders-server. Steps the shared environments with
+// pseudo random actions and reports the round trip latency. With --verify it
+// also runs the same environments in-process and checks every observation
+int main(int argc, char **args) {
+  std::string name = "/invaders";
+  const char *verifyRom = nullptr;
+  uint64_t steps = 10'000;
+  bool shutdown = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(args[i], "--name") == 0 && i + 1 < argc) {
+      name = args[++i];
+    } else if (strcmp(args[i], "--steps") == 0 && i + 1 < argc) {
+      steps = std::stoull(args[++i]);
+    } else if (strcmp(args[i], "--verify") == 0 && i + 1 < argc) {
+      verifyRom = args[++i];
+    } else if (strcmp(args[i], "--shutdown") == 0) {
+      shutdown = true;
+    } else {
+      std::cout << "Usage: " << args[0]
+                << " [--name /invaders] [--steps N] [--verify ROM]"
+                   " [--shutdown]"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  auto fd = shm_open(name.c_str(), O_RDWR, 0);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    std::cerr << "Unable to open shared memory \"" << name
+              << "\": " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  auto *base = (uint8_t *)mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE,
+                               MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    std::cerr << "Unable to map shared memory: " << strerror(errno)
+              << std::endl;
+    return -1;
+  }
+
+  auto *header = (invaders::ShmHeader *)base;
+  if (header->magic.load(std::memory_order_acquire) != invaders::kShmMagic ||
+      header->version != invaders::kShmVersion ||
+      header->totalSize > (uint64_t)st.st_size) {
+    std::cerr << "\"" << name << "\" is not an invaders-server segment"
+              << std::endl;
+    return -1;
+  }
+
+  auto envCount = header->envCount;
+  auto obsSize = header->obsSize;
+  auto *actions = (uint16_t *)(base + header->actionsOffset);
+  auto *resets = base + header->resetsOffset;
+  auto *observations = base + header->observationsOffset;
+
+  std::unique_ptr<invaders::VecEnv> reference;
+  std::vector<uint8_t> expected;
+  if (verifyRom != nullptr) {
+    reference = std::make_unique<invaders::VecEnv>(
+        envCount, (invaders::ObservationType)header->obsType,
+        header->frameSkip, header->maxPool != 0, header->frameStack);
+    reference->SetDipSwitches(header->dipSwitches);
+    if (!reference->LoadROM(verifyRom)) {
+      return -1;
+    }
+    expected.resize((size_t)envCount * obsSize);
+  }
+
+  auto request = header->response.load(std::memory_order_acquire);
+  auto roundTrip = [&](invaders::ShmCommand command) {
+    header->command.store(command, std::memory_order_relaxed);
+    header->request.store(++request, std::memory_order_release);
+    invaders::ShmWake(header->request);
+
+    auto serving = [&] {
+      return header->magic.load(std::memory_order_acquire) ==
+             invaders::kShmMagic;
+    };
+    auto seen = request - 1;
+    while (seen != request && serving()) {
+      seen = invaders::ShmWait(header->response, seen, 1000);
+    }
+    return serving();
+  };
+
+  // Start from the power-on state so the in-process reference matches
+  std::fill(resets, resets + envCount, 1);
+  if (!roundTrip(invaders::SHM_RESET)) {
+    std::cerr << "Server went away" << std::endl;
+    return -1;
+  }
+
+  std::vector<uint64_t> latencies;
+  std::vector<uint64_t> overheads;
+  latencies.reserve(steps);
+  overheads.reserve(steps);
+
+  const uint16_t keys[] = {0,
+                           invaders::COIN,
+                           invaders::P1_START,
+                           invaders::P1_LEFT,
+                           invaders::P1_RIGHT,
+                           invaders::P1_FIRE,
+                           invaders::P1_LEFT | invaders::P1_FIRE,
+                           invaders::P1_RIGHT | invaders::P1_FIRE};
+  std::vector<uint16_t> stepActions(envCount);
+  uint32_t rng = 0x2545f491;
+  uint64_t mismatches = 0;
+
+  for (uint64_t step = 0; step < steps; ++step) {
+    for (uint32_t i = 0; i < envCount; ++i) {
+      rng ^= rng << 13;
+      rng ^= rng >> 17;
+      rng ^= rng << 5;
+      stepActions[i] = keys[rng % (sizeof(keys) / sizeof(keys[0]))];
+      actions[i] = stepActions[i];
+    }
+
+    auto start = NowNanos();
+    if (!roundTrip(invaders::SHM_STEP)) {
+      std::cerr << "Server went away" << std::endl;
+      return -1;
+    }
+    auto elapsed = NowNanos() - start;
+    latencies.push_back(elapsed);
+    overheads.push_back(elapsed - std::min(elapsed, header->lastStepNanos));
+
+    if (reference) {
+      reference->Step(stepActions.data(), expected.data());
+      if (memcmp(expected.data(), observations, expected.size()) != 0) {
+        if (mismatches == 0) {
+          std::cerr << "Observation mismatch at step " << step << std::endl;
+        }
+        ++mismatches;
+      }
+    }
+  }
+
+  if (shutdown) {
+    roundTrip(invaders::SHM_SHUTDOWN);
+  }
+
+  auto percentile = [](std::vector<uint64_t> &values, double p) {
+    if (values.empty()) {
+      return 0.0;
+    }
+    auto index = (size_t)(p * (values.size() - 1));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index] / 1000.0;
+  };
+
+  std::cout << "Steps: " << steps << " x " << envCount << " environments"
+            << std::endl
+            << "Round trip (us): p50 " << percentile(latencies, 0.5)
+            << ", p99 " << percentile(latencies, 0.99) << std::endl
+            << "IPC overhead (us): p50 " << percentile(overheads, 0.5)
+            << ", p99 " << percentile(overheads, 0.99) << std::endl;
+
+  if (reference) {
+    std::cout << "Verification: "
+              << (mismatches == 0 ? "passed" : "FAILED") << " ("
+              << mismatches << " mismatching steps)" << std::endl;
+  }
+
+  munmap(base, st.st_size);
+
+  return mismatches == 0 ? 0 : 1;
+}
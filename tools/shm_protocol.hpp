@@ -0,0 +1,113 @@
+#include <atomic>
+#include <errno.h>
+#include <linux/futex.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+
+namespace invaders {
+#pragma once
+// Layout of the shared memory segment exported by invaders-server:
+//
+//   ShmHeader | actions (uint16_t * envCount) | resets (uint8_t * envCount) |
+//   observations (obsSize * envCount)
+//
+// All offsets are relative to the start of the segment. To step, a client
+// writes the actions (and optionally sets reset flags), stores the command,
+// bumps `request` and wakes it. The server runs the step, writes the
+// observations and publishes `response = request`.
+constexpr uint32_t kShmMagic = 0x534e5649; // "INVS"
+constexpr uint32_t kShmVersion = 3;
+
+enum ShmCommand : uint32_t {
+  SHM_STEP = 0,
+  // Resets the environments flagged in the resets array, then observes
+  SHM_RESET = 1,
+  SHM_SHUTDOWN = 2,
+};
+
+struct ShmHeader {
+  // Stored last with release order once the segment is set up, and cleared
+  // when the server exits
+  std::atomic<uint32_t> magic;
+  uint32_t version;
+  uint32_t envCount;
+  // ObservationType
+  uint32_t obsType;
+  // Bytes per environment, including every stacked frame
+  uint32_t obsSize;
+  uint32_t frameSkip;
+  uint32_t maxPool;
+  uint32_t frameStack;
+  // DipSwitch bits
+  uint32_t dipSwitches;
+
+  uint64_t actionsOffset;
+  uint64_t resetsOffset;
+  uint64_t observationsOffset;
+  uint64_t totalSize;
+
+  // Host time the server spent in the last step, for separating IPC latency
+  // from emulation time
+  uint64_t lastStepNanos;
+
+  // Futex words, each on its own cache line
+  alignas(64) std::atomic<uint32_t> command;
+  alignas(64) std::atomic<uint32_t> request;
+  alignas(64) std::atomic<uint32_t> response;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+              "Futex words must be lock-free to be shared between processes");
+
+inline size_t ShmAlign(size_t size) { return (size + 63) & ~(size_t)63; }
+
+inline size_t ShmSegmentSize(uint32_t envCount, uint32_t obsSize) {
+  return ShmAlign(sizeof(ShmHeader)) + ShmAlign(envCount * sizeof(uint16_t)) +
+         ShmAlign(envCount) + (size_t)envCount * obsSize;
+}
+
+inline void ShmWake(std::atomic<uint32_t> &word) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, 1,
+          nullptr, nullptr, 0);
+}
+
+// Waits until `word` differs from `seen` and returns the new value. Spins
+// briefly before sleeping on the futex since a step is usually answered
+// within microseconds. Spinning only steals time from the other side on a
+// single core, so it is skipped there. Returns `seen` if `timeoutMs` expires
+// first
+inline uint32_t ShmWait(std::atomic<uint32_t> &word, uint32_t seen,
+                        int timeoutMs = -1) {
+  static const int spins = std::thread::hardware_concurrency() > 1 ? 4096 : 0;
+
+  for (int i = 0; i < spins; ++i) {
+    auto value = word.load(std::memory_order_acquire);
+    if (value != seen) {
+      return value;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  }
+
+  timespec timeout = {timeoutMs / 1000, (timeoutMs % 1000) * 1'000'000L};
+
+  while (true) {
+    auto value = word.load(std::memory_order_acquire);
+    if (value != seen) {
+      return value;
+    }
+
+    auto res = syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word),
+                       FUTEX_WAIT, seen, timeoutMs < 0 ? nullptr : &timeout,
+                       nullptr, 0);
+    if (res != 0 && errno == ETIMEDOUT) {
+      return word.load(std::memory_order_acquire);
+    }
+  }
+}
+} // namespace invaders
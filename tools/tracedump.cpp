@@ -0,0 +1,73 @@
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include "tracer.hpp"
+
+// Converts a binary execution trace into one line of text per instruction
+int main(int argc, char **args) {
+  if (argc < 2) {
+    std::cout << "Usage: " << args[0] << " <trace> [--limit N]" << std::endl;
+    return 1;
+  }
+
+  uint64_t limit = UINT64_MAX;
+  for (int i = 2; i < argc; i++) {
+    if (strcmp(args[i], "--limit") == 0 && i + 1 < argc) {
+      limit = std::stoull(args[++i]);
+    }
+  }
+
+  FILE *file = fopen(args[1], "rb");
+  if (file == nullptr) {
+    std::cerr << "Unable to open \"" << args[1] << "\"" << std::endl;
+    return -1;
+  }
+
+  invaders::TraceHeader header;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      header.magic != invaders::kTraceMagic ||
+      header.version != invaders::kTraceVersion ||
+      header.recordSize != sizeof(invaders::TraceRecord)) {
+    std::cerr << "\"" << args[1] << "\" is not a trace file" << std::endl;
+    fclose(file);
+    return -1;
+  }
+
+  std::vector<invaders::TraceRecord> batch(1 << 14);
+  uint64_t printed = 0;
+  char line[128];
+
+  while (printed < limit) {
+    auto count = fread(batch.data(), sizeof(invaders::TraceRecord),
+                       batch.size(), file);
+    if (count == 0) {
+      break;
+    }
+
+    for (size_t i = 0; i < count && printed < limit; ++i, ++printed) {
+      auto &r = batch[i];
+
+      if (r.gap) {
+        snprintf(line, sizeof(line), "--- %llu records dropped ---\n",
+                 (unsigned long long)r.cycle);
+      } else {
+        snprintf(line, sizeof(line),
+                 "%012llu PC:%04x OP:%02x A:%02x B:%02x C:%02x D:%02x "
+                 "E:%02x H:%02x L:%02x SP:%04x F:%c%c%c%c%c\n",
+                 (unsigned long long)r.cycle, r.pc, r.opcode, r.a, r.b, r.c,
+                 r.d, r.e, r.h, r.l, r.sp, (r.flags & 0x80) ? 'S' : '-',
+                 (r.flags & 0x40) ? 'Z' : '-', (r.flags & 0x10) ? 'A' : '-',
+                 (r.flags & 0x04) ? 'P' : '-', (r.flags & 0x01) ? 'C' : '-');
+      }
+      fputs(line, stdout);
+    }
+  }
+
+  fclose(file);
+
+  return 0;
+}